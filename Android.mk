@@ -19,7 +19,7 @@ LOCAL_C_INCLUDES  := \
 	${LOGGER_SRC_PATH} \
 
 LOCAL_SRC_FILES := \
-	$(subst $(LOCAL_PATH)/,,$(shell find $(LOCAL_PATH) -name "*.c" -print)) \
+	$(subst $(LOCAL_PATH)/,,$(shell find $(LOCAL_PATH) -name "*.c" -not -path "$(LOCAL_PATH)/test/*" -print)) \
 
 LOCAL_STATIC_LIBRARIES := \
 	freetype \
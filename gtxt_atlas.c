@@ -0,0 +1,495 @@
+#include "gtxt_atlas.h"
+#include "gtxt_typedef.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define PADDING 1
+
+struct skyline_node {
+	int x, y, w;
+};
+
+struct rect {
+	int x, y, w, h;
+};
+
+struct page {
+	uint8_t* pixels;
+
+	struct skyline_node* nodes;
+	int node_count;
+
+	// freed under the skyline, taken before it, padding included
+	struct rect* holes;
+	int hole_count, hole_cap;
+
+	int version;
+	int live;
+	int pins;
+	unsigned int last_use;
+	bool dirty;
+};
+
+struct gtxt_atlas {
+	int width, height;
+	int bpp;
+
+	struct page* pages;
+	int page_count;
+	int max_pages;
+
+	unsigned int tick;
+};
+
+static inline void
+_page_reset(struct gtxt_atlas* a, struct page* p) {
+	p->node_count = 1;
+	p->nodes[0].x = 0;
+	p->nodes[0].y = 0;
+	p->nodes[0].w = a->width;
+	p->hole_count = 0;
+
+	memset(p->pixels, 0, (size_t)a->width * a->height * a->bpp);
+
+	++p->version;
+	p->live = 0;
+	p->pins = 0;
+	p->dirty = true;
+}
+
+static inline struct page*
+_page_new(struct gtxt_atlas* a) {
+	assert(a->page_count < a->max_pages);
+	struct page* p = &a->pages[a->page_count];
+	p->pixels = (uint8_t*)malloc((size_t)a->width * a->height * a->bpp);
+	p->nodes = (struct skyline_node*)malloc(sizeof(struct skyline_node) * (a->width + 1));
+	if (!p->pixels || !p->nodes) {
+		free(p->pixels); p->pixels = NULL;
+		free(p->nodes); p->nodes = NULL;
+		return NULL;
+	}
+	++a->page_count;
+	_page_reset(a, p);
+	return p;
+}
+
+struct gtxt_atlas*
+gtxt_atlas_create(int width, int height, int max_pages, int bpp) {
+	if (width <= 0 || height <= 0 || max_pages <= 0 || bpp <= 0) {
+		return NULL;
+	}
+
+	struct gtxt_atlas* a = (struct gtxt_atlas*)malloc(sizeof(*a));
+	if (!a) {
+		return NULL;
+	}
+	memset(a, 0, sizeof(*a));
+
+	a->width = width;
+	a->height = height;
+	a->bpp = bpp;
+	a->max_pages = max_pages;
+
+	a->pages = (struct page*)malloc(sizeof(struct page) * max_pages);
+	if (!a->pages) {
+		free(a);
+		return NULL;
+	}
+	memset(a->pages, 0, sizeof(struct page) * max_pages);
+
+	return a;
+}
+
+void
+gtxt_atlas_release(struct gtxt_atlas* a) {
+	if (!a) {
+		return;
+	}
+	for (int i = 0; i < a->page_count; ++i) {
+		free(a->pages[i].pixels);
+		free(a->pages[i].nodes);
+		free(a->pages[i].holes);
+	}
+	free(a->pages);
+	free(a);
+}
+
+// bottom of the skyline under [x, x+w) starting from node i, or -1
+static inline int
+_rect_fits(struct gtxt_atlas* a, struct page* p, int i, int w, int h) {
+	int x = p->nodes[i].x;
+	int y = p->nodes[i].y;
+	if (x + w > a->width) {
+		return -1;
+	}
+	int remain = w;
+	while (remain > 0) {
+		if (i == p->node_count) {
+			return -1;
+		}
+		y = MAX(y, p->nodes[i].y);
+		if (y + h > a->height) {
+			return -1;
+		}
+		remain -= p->nodes[i].w;
+		++i;
+	}
+	return y;
+}
+
+static inline void
+_merge_skyline(struct page* p) {
+	for (int i = 0; i < p->node_count - 1; ++i) {
+		if (p->nodes[i].y == p->nodes[i + 1].y) {
+			p->nodes[i].w += p->nodes[i + 1].w;
+			memmove(&p->nodes[i + 1], &p->nodes[i + 2], sizeof(struct skyline_node) * (p->node_count - i - 2));
+			--p->node_count;
+			--i;
+		}
+	}
+}
+
+static inline void
+_add_skyline_level(struct page* p, int idx, int x, int y, int w, int h) {
+	memmove(&p->nodes[idx + 1], &p->nodes[idx], sizeof(struct skyline_node) * (p->node_count - idx));
+	p->nodes[idx].x = x;
+	p->nodes[idx].y = y + h;
+	p->nodes[idx].w = w;
+	++p->node_count;
+
+	// shrink the nodes covered by the new level
+	for (int i = idx + 1; i < p->node_count; ++i) {
+		struct skyline_node* prev = &p->nodes[i - 1];
+		struct skyline_node* curr = &p->nodes[i];
+		if (curr->x >= prev->x + prev->w) {
+			break;
+		}
+		int shrink = prev->x + prev->w - curr->x;
+		curr->x += shrink;
+		curr->w -= shrink;
+		if (curr->w > 0) {
+			break;
+		}
+		memmove(curr, curr + 1, sizeof(struct skyline_node) * (p->node_count - i - 1));
+		--p->node_count;
+		--i;
+	}
+
+	_merge_skyline(p);
+}
+
+// the rect lies right under the skyline, which drops to its bottom there;
+// false if anything was placed over it
+static bool
+_lower_skyline(struct page* p, int x, int y, int w, int h) {
+	int top = y + h;
+	int i = 0;
+	while (p->nodes[i].x + p->nodes[i].w <= x) {
+		++i;
+	}
+	int j = i;
+	for ( ; j < p->node_count && p->nodes[j].x < x + w; ++j) {
+		if (p->nodes[j].y != top) {
+			return false;
+		}
+	}
+	--j;
+
+	// split the end nodes at the rect's edges, there is room for both as
+	// nodes are at least 1 wide
+	struct skyline_node* last = &p->nodes[j];
+	if (last->x + last->w > x + w) {
+		memmove(&p->nodes[j + 2], &p->nodes[j + 1], sizeof(struct skyline_node) * (p->node_count - j - 1));
+		p->nodes[j + 1].x = x + w;
+		p->nodes[j + 1].y = top;
+		p->nodes[j + 1].w = last->x + last->w - (x + w);
+		last->w = x + w - last->x;
+		++p->node_count;
+	}
+	struct skyline_node* first = &p->nodes[i];
+	if (first->x < x) {
+		memmove(&p->nodes[i + 2], &p->nodes[i + 1], sizeof(struct skyline_node) * (p->node_count - i - 1));
+		p->nodes[i + 1].x = x;
+		p->nodes[i + 1].y = top;
+		p->nodes[i + 1].w = first->x + first->w - x;
+		first->w = x - first->x;
+		++p->node_count;
+		++i;
+		++j;
+	}
+
+	// [i, j] covers the rect exactly
+	p->nodes[i].x = x;
+	p->nodes[i].y = y;
+	p->nodes[i].w = w;
+	memmove(&p->nodes[i + 1], &p->nodes[j + 1], sizeof(struct skyline_node) * (p->node_count - j - 1));
+	p->node_count -= j - i;
+
+	_merge_skyline(p);
+	return true;
+}
+
+static void
+_add_hole(struct page* p, int x, int y, int w, int h) {
+	if (w <= 0 || h <= 0) {
+		return;
+	}
+	if (p->hole_count == p->hole_cap) {
+		int cap = p->hole_cap ? p->hole_cap * 2 : 16;
+		struct rect* holes = (struct rect*)realloc(p->holes, sizeof(struct rect) * cap);
+		if (!holes) {
+			// lost until the page is reset
+			return;
+		}
+		p->holes = holes;
+		p->hole_cap = cap;
+	}
+	struct rect* r = &p->holes[p->hole_count++];
+	r->x = x;
+	r->y = y;
+	r->w = w;
+	r->h = h;
+}
+
+// the smallest hole it fits in, split into what is left on the right and
+// below
+static bool
+_hole_alloc(struct page* p, int w, int h, int* rx, int* ry) {
+	int best = -1;
+	for (int i = 0; i < p->hole_count; ++i) {
+		const struct rect* r = &p->holes[i];
+		if (r->w >= w && r->h >= h
+		 && (best == -1 || r->w * r->h < p->holes[best].w * p->holes[best].h)) {
+			best = i;
+		}
+	}
+	if (best == -1) {
+		return false;
+	}
+
+	struct rect r = p->holes[best];
+	p->holes[best] = p->holes[--p->hole_count];
+	_add_hole(p, r.x + w, r.y, r.w - w, h);
+	_add_hole(p, r.x, r.y + h, r.w, r.h - h);
+	*rx = r.x;
+	*ry = r.y;
+	return true;
+}
+
+static bool
+_page_alloc(struct gtxt_atlas* a, struct page* p, int w, int h, int* rx, int* ry) {
+	if (_hole_alloc(p, w, h, rx, ry)) {
+		return true;
+	}
+
+	int best_idx = -1, best_w = a->width + 1, best_h = a->height + 1;
+	int best_x = 0, best_y = 0;
+	for (int i = 0; i < p->node_count; ++i) {
+		int y = _rect_fits(a, p, i, w, h);
+		if (y == -1) {
+			continue;
+		}
+		if (y + h < best_h || (y + h == best_h && p->nodes[i].w < best_w)) {
+			best_idx = i;
+			best_w = p->nodes[i].w;
+			best_h = y + h;
+			best_x = p->nodes[i].x;
+			best_y = y;
+		}
+	}
+	if (best_idx == -1) {
+		return false;
+	}
+
+	_add_skyline_level(p, best_idx, best_x, best_y, w, h);
+	*rx = best_x;
+	*ry = best_y;
+	return true;
+}
+
+bool
+gtxt_atlas_alloc(struct gtxt_atlas* a, int w, int h, struct gtxt_atlas_region* region) {
+	int pw = w + PADDING,
+		ph = h + PADDING;
+	if (w <= 0 || h <= 0 || pw > a->width || ph > a->height) {
+		return false;
+	}
+
+	int x = 0, y = 0;
+	int page = -1;
+	for (int i = 0; i < a->page_count; ++i) {
+		if (_page_alloc(a, &a->pages[i], pw, ph, &x, &y)) {
+			page = i;
+			break;
+		}
+	}
+
+	if (page == -1) {
+		struct page* p = NULL;
+		if (a->page_count < a->max_pages) {
+			p = _page_new(a);
+		}
+		if (!p) {
+			if (a->page_count == 0) {
+				return false;
+			}
+			// all pages full, recycle the least recently used one
+			for (int i = 0; i < a->page_count; ++i) {
+				struct page* curr = &a->pages[i];
+				if (curr->pins == 0 && (!p || curr->last_use < p->last_use)) {
+					p = curr;
+				}
+			}
+			if (!p) {
+				return false;
+			}
+			_page_reset(a, p);
+		}
+		if (!_page_alloc(a, p, pw, ph, &x, &y)) {
+			return false;
+		}
+		page = (int)(p - a->pages);
+	}
+
+	struct page* p = &a->pages[page];
+	++p->live;
+	p->last_use = ++a->tick;
+
+	region->page = page;
+	region->version = p->version;
+	region->x = x;
+	region->y = y;
+	region->w = w;
+	region->h = h;
+
+	return true;
+}
+
+void
+gtxt_atlas_free(struct gtxt_atlas* a, const struct gtxt_atlas_region* region) {
+	if (!gtxt_atlas_is_valid(a, region)) {
+		return;
+	}
+	struct page* p = &a->pages[region->page];
+	assert(p->live > 0);
+	if (--p->live == 0) {
+		_page_reset(a, p);
+		return;
+	}
+
+	// blank for the next one, padding included
+	int w = region->w + PADDING,
+		h = region->h + PADDING;
+	size_t page_row_sz = (size_t)a->width * a->bpp;
+	uint8_t* dst = p->pixels + region->y * page_row_sz + region->x * a->bpp;
+	for (int i = 0; i < h; ++i) {
+		memset(dst, 0, (size_t)w * a->bpp);
+		dst += page_row_sz;
+	}
+	p->dirty = true;
+
+	if (!_lower_skyline(p, region->x, region->y, w, h)) {
+		_add_hole(p, region->x, region->y, w, h);
+	}
+}
+
+bool
+gtxt_atlas_is_valid(struct gtxt_atlas* a, const struct gtxt_atlas_region* region) {
+	return region->page >= 0
+		&& region->page < a->page_count
+		&& a->pages[region->page].version == region->version;
+}
+
+void
+gtxt_atlas_touch(struct gtxt_atlas* a, const struct gtxt_atlas_region* region) {
+	if (gtxt_atlas_is_valid(a, region)) {
+		a->pages[region->page].last_use = ++a->tick;
+	}
+}
+
+void
+gtxt_atlas_pin(struct gtxt_atlas* a, const struct gtxt_atlas_region* region, bool pin) {
+	if (!gtxt_atlas_is_valid(a, region)) {
+		return;
+	}
+	struct page* p = &a->pages[region->page];
+	if (pin) {
+		++p->pins;
+	} else {
+		assert(p->pins > 0);
+		--p->pins;
+	}
+}
+
+void
+gtxt_atlas_write(struct gtxt_atlas* a, const struct gtxt_atlas_region* region, const void* pixels) {
+	if (!gtxt_atlas_is_valid(a, region)) {
+		return;
+	}
+	struct page* p = &a->pages[region->page];
+	size_t row_sz = (size_t)region->w * a->bpp;
+	size_t page_row_sz = (size_t)a->width * a->bpp;
+	const uint8_t* src = (const uint8_t*)pixels;
+	uint8_t* dst = p->pixels + region->y * page_row_sz + region->x * a->bpp;
+	for (int i = 0; i < region->h; ++i) {
+		memcpy(dst, src, row_sz);
+		src += row_sz;
+		dst += page_row_sz;
+	}
+	p->dirty = true;
+}
+
+bool
+gtxt_atlas_read(struct gtxt_atlas* a, const struct gtxt_atlas_region* region, void* pixels) {
+	if (!gtxt_atlas_is_valid(a, region)) {
+		return false;
+	}
+	struct page* p = &a->pages[region->page];
+	size_t row_sz = (size_t)region->w * a->bpp;
+	size_t page_row_sz = (size_t)a->width * a->bpp;
+	const uint8_t* src = p->pixels + region->y * page_row_sz + region->x * a->bpp;
+	uint8_t* dst = (uint8_t*)pixels;
+	for (int i = 0; i < region->h; ++i) {
+		memcpy(dst, src, row_sz);
+		src += page_row_sz;
+		dst += row_sz;
+	}
+	return true;
+}
+
+void*
+gtxt_atlas_map(struct gtxt_atlas* a, const struct gtxt_atlas_region* region, int* stride) {
+	if (!gtxt_atlas_is_valid(a, region)) {
+		return NULL;
+	}
+	struct page* p = &a->pages[region->page];
+	p->dirty = true;
+	*stride = a->width * a->bpp;
+	return p->pixels + (size_t)region->y * *stride + region->x * a->bpp;
+}
+
+int
+gtxt_atlas_get_page_count(struct gtxt_atlas* a) {
+	return a->page_count;
+}
+
+void*
+gtxt_atlas_get_page(struct gtxt_atlas* a, int page, int* width, int* height, bool* dirty) {
+	if (page < 0 || page >= a->page_count) {
+		return NULL;
+	}
+	struct page* p = &a->pages[page];
+	if (width) {
+		*width = a->width;
+	}
+	if (height) {
+		*height = a->height;
+	}
+	if (dirty) {
+		*dirty = p->dirty;
+		p->dirty = false;
+	}
+	return p->pixels;
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifndef gametext_atlas_h
+#define gametext_atlas_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct gtxt_atlas;
+
+struct gtxt_atlas_region {
+	int page;
+	int version;
+	int x, y, w, h;
+};
+
+struct gtxt_atlas* gtxt_atlas_create(int width, int height, int max_pages, int bpp);
+void gtxt_atlas_release(struct gtxt_atlas*);
+
+bool gtxt_atlas_alloc(struct gtxt_atlas*, int w, int h, struct gtxt_atlas_region* region);
+// the space is taken again, by the skyline if nothing is above it, else as
+// a hole that later regions fit in; pages are reset once empty
+void gtxt_atlas_free(struct gtxt_atlas*, const struct gtxt_atlas_region* region);
+
+bool gtxt_atlas_is_valid(struct gtxt_atlas*, const struct gtxt_atlas_region* region);
+void gtxt_atlas_touch(struct gtxt_atlas*, const struct gtxt_atlas_region* region);
+// pages with pinned regions are never recycled, pins nest
+void gtxt_atlas_pin(struct gtxt_atlas*, const struct gtxt_atlas_region* region, bool pin);
+
+void gtxt_atlas_write(struct gtxt_atlas*, const struct gtxt_atlas_region* region, const void* pixels);
+bool gtxt_atlas_read(struct gtxt_atlas*, const struct gtxt_atlas_region* region, void* pixels);
+// first row of the region for writing in place, marks the page dirty
+void* gtxt_atlas_map(struct gtxt_atlas*, const struct gtxt_atlas_region* region, int* stride);
+
+int gtxt_atlas_get_page_count(struct gtxt_atlas*);
+void* gtxt_atlas_get_page(struct gtxt_atlas*, int page, int* width, int* height, bool* dirty);
+
+#endif // gametext_atlas_h
+
+#ifdef __cplusplus
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,422 @@
+#include "gtxt_disk.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+
+#ifdef _WIN32
+#	include <windows.h>
+#else
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
+
+#define DISK_MAGIC		"GTXD"
+#define DISK_VERSION	1
+#define DISK_ENDIAN		0x01020304
+
+#define RECORD_ALIGN	16
+
+struct header {
+	char magic[4];
+	uint32_t version;
+	uint32_t endian;
+	uint32_t format;
+	uint32_t flags;
+	uint32_t font_count;
+	uint32_t count;
+	uint32_t padding;
+};
+
+struct entry {
+	uint64_t hash;
+	uint32_t offset;
+	uint32_t size;
+	int32_t font;
+	uint32_t padding;
+};
+
+struct gtxt_disk {
+	const uint8_t* base;
+	size_t size;
+
+	const struct header* header;
+	const struct entry* entries;
+
+	bool* font_valid;
+
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+};
+
+static inline size_t
+_align(size_t sz) {
+	return (sz + RECORD_ALIGN - 1) & ~(size_t)(RECORD_ALIGN - 1);
+}
+
+// 64 bits, counts read from the file overflow a 32 bit size_t
+static inline uint64_t
+_records_offset(uint32_t font_count, uint32_t count) {
+	uint64_t sz = sizeof(struct header) + sizeof(uint64_t) * (uint64_t)font_count + sizeof(struct entry) * (uint64_t)count;
+	return (sz + RECORD_ALIGN - 1) & ~(uint64_t)(RECORD_ALIGN - 1);
+}
+
+static bool
+_map(struct gtxt_disk* d, const char* filepath) {
+#ifdef _WIN32
+	d->file = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (d->file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER sz;
+	if (!GetFileSizeEx(d->file, &sz) || sz.QuadPart == 0) {
+		CloseHandle(d->file);
+		return false;
+	}
+	d->mapping = CreateFileMappingA(d->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!d->mapping) {
+		CloseHandle(d->file);
+		return false;
+	}
+	d->base = (const uint8_t*)MapViewOfFile(d->mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!d->base) {
+		CloseHandle(d->mapping);
+		CloseHandle(d->file);
+		return false;
+	}
+	d->size = (size_t)sz.QuadPart;
+#else
+	int fd = open(filepath, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+	void* base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		return false;
+	}
+	d->base = (const uint8_t*)base;
+	d->size = (size_t)st.st_size;
+#endif
+	return true;
+}
+
+static void
+_unmap(struct gtxt_disk* d) {
+#ifdef _WIN32
+	UnmapViewOfFile(d->base);
+	CloseHandle(d->mapping);
+	CloseHandle(d->file);
+#else
+	munmap((void*)d->base, d->size);
+#endif
+}
+
+// sets the header and entries once they are known to be in the file
+static bool
+_check(struct gtxt_disk* d, uint32_t format) {
+	if (d->size < sizeof(struct header)) {
+		return false;
+	}
+	const struct header* h = (const struct header*)d->base;
+	if (memcmp(h->magic, DISK_MAGIC, sizeof(h->magic)) != 0
+	 || h->version != DISK_VERSION
+	 || h->endian != DISK_ENDIAN
+	 || h->format != format) {
+		return false;
+	}
+
+	uint64_t records = _records_offset(h->font_count, h->count);
+	if (h->font_count > 0xffff || records > (uint64_t)d->size) {
+		return false;
+	}
+	d->header = h;
+	d->entries = (const struct entry*)(d->base + sizeof(struct header) + sizeof(uint64_t) * h->font_count);
+	for (uint32_t i = 0; i < h->count; ++i) {
+		const struct entry* e = &d->entries[i];
+		if (e->offset < records
+		 || e->offset % RECORD_ALIGN != 0
+		 || (uint64_t)e->offset + e->size > (uint64_t)d->size
+		 || (i > 0 && e->hash < d->entries[i - 1].hash)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+struct gtxt_disk*
+gtxt_disk_open(const char* filepath, uint32_t format, const uint64_t* font_checksums, int font_count) {
+	struct gtxt_disk* d = (struct gtxt_disk*)malloc(sizeof(*d));
+	if (!d) {
+		return NULL;
+	}
+	memset(d, 0, sizeof(*d));
+
+	if (!_map(d, filepath)) {
+		free(d);
+		return NULL;
+	}
+
+	if (!_check(d, format)) {
+		gtxt_disk_close(d);
+		return NULL;
+	}
+	const uint64_t* checksums = (const uint64_t*)(d->base + sizeof(struct header));
+
+	int n = (int)d->header->font_count;
+	d->font_valid = (bool*)malloc(sizeof(bool) * (n > 0 ? n : 1));
+	if (!d->font_valid) {
+		gtxt_disk_close(d);
+		return NULL;
+	}
+	for (int i = 0; i < n; ++i) {
+		d->font_valid[i] = i < font_count && checksums[i] == font_checksums[i];
+	}
+
+	return d;
+}
+
+void
+gtxt_disk_close(struct gtxt_disk* d) {
+	if (!d) {
+		return;
+	}
+	_unmap(d);
+	free(d->font_valid);
+	free(d);
+}
+
+uint32_t
+gtxt_disk_get_flags(struct gtxt_disk* d) {
+	return d->header->flags;
+}
+
+static inline bool
+_is_font_valid(struct gtxt_disk* d, int font) {
+	return font >= 0 && (uint32_t)font < d->header->font_count && d->font_valid[font];
+}
+
+const void*
+gtxt_disk_query(struct gtxt_disk* d, uint64_t hash, const void* key, bool (*equal)(const void* key, const void* record), size_t* size) {
+	// lower bound
+	uint32_t lo = 0, hi = d->header->count;
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (d->entries[mid].hash < hash) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	for ( ; lo < d->header->count && d->entries[lo].hash == hash; ++lo) {
+		const struct entry* e = &d->entries[lo];
+		if (!_is_font_valid(d, e->font)) {
+			continue;
+		}
+		const void* record = d->base + e->offset;
+		if (equal(key, record)) {
+			if (size) {
+				*size = e->size;
+			}
+			return record;
+		}
+	}
+	return NULL;
+}
+
+int
+gtxt_disk_count(struct gtxt_disk* d) {
+	return (int)d->header->count;
+}
+
+const void*
+gtxt_disk_get(struct gtxt_disk* d, int idx, uint64_t* hash, size_t* size) {
+	if (idx < 0 || (uint32_t)idx >= d->header->count) {
+		return NULL;
+	}
+	const struct entry* e = &d->entries[idx];
+	if (!_is_font_valid(d, e->font)) {
+		return NULL;
+	}
+	if (hash) {
+		*hash = e->hash;
+	}
+	if (size) {
+		*size = e->size;
+	}
+	return d->base + e->offset;
+}
+
+struct gtxt_disk_writer {
+	struct header header;
+	uint64_t* checksums;
+
+	struct entry* entries;
+	uint32_t entry_cap;
+
+	uint8_t* records;
+	size_t records_sz, records_cap;
+};
+
+struct gtxt_disk_writer*
+gtxt_disk_writer_create(uint32_t format, uint32_t flags, const uint64_t* font_checksums, int font_count) {
+	struct gtxt_disk_writer* w = (struct gtxt_disk_writer*)malloc(sizeof(*w));
+	if (!w) {
+		return NULL;
+	}
+	memset(w, 0, sizeof(*w));
+
+	memcpy(w->header.magic, DISK_MAGIC, sizeof(w->header.magic));
+	w->header.version = DISK_VERSION;
+	w->header.endian = DISK_ENDIAN;
+	w->header.format = format;
+	w->header.flags = flags;
+	w->header.font_count = font_count;
+
+	w->checksums = (uint64_t*)malloc(sizeof(uint64_t) * (font_count > 0 ? font_count : 1));
+	if (!w->checksums) {
+		free(w);
+		return NULL;
+	}
+	memcpy(w->checksums, font_checksums, sizeof(uint64_t) * font_count);
+
+	return w;
+}
+
+void
+gtxt_disk_writer_release(struct gtxt_disk_writer* w) {
+	if (!w) {
+		return;
+	}
+	free(w->checksums);
+	free(w->entries);
+	free(w->records);
+	free(w);
+}
+
+bool
+gtxt_disk_writer_add(struct gtxt_disk_writer* w, uint64_t hash, int font, const void* head, size_t head_sz, const void* data, size_t data_sz) {
+	if (w->header.count == w->entry_cap) {
+		uint32_t cap = w->entry_cap ? w->entry_cap * 2 : 256;
+		struct entry* entries = (struct entry*)realloc(w->entries, sizeof(struct entry) * cap);
+		if (!entries) {
+			return false;
+		}
+		w->entries = entries;
+		w->entry_cap = cap;
+	}
+
+	size_t sz = head_sz + data_sz;
+	size_t offset = w->records_sz;
+	size_t end = _align(offset + sz);
+	if (end > UINT32_MAX) {
+		return false;
+	}
+	if (end > w->records_cap) {
+		size_t cap = w->records_cap ? w->records_cap : 64 * 1024;
+		while (cap < end) {
+			cap *= 2;
+		}
+		uint8_t* records = (uint8_t*)realloc(w->records, cap);
+		if (!records) {
+			return false;
+		}
+		w->records = records;
+		w->records_cap = cap;
+	}
+
+	memcpy(w->records + offset, head, head_sz);
+	if (data_sz > 0) {
+		memcpy(w->records + offset + head_sz, data, data_sz);
+	}
+	memset(w->records + offset + sz, 0, end - offset - sz);
+	w->records_sz = end;
+
+	struct entry* e = &w->entries[w->header.count++];
+	memset(e, 0, sizeof(*e));
+	e->hash = hash;
+	e->offset = (uint32_t)offset;
+	e->size = (uint32_t)sz;
+	e->font = font;
+
+	return true;
+}
+
+static int
+_entry_cmp(const void* a, const void* b) {
+	uint64_t ha = ((const struct entry*)a)->hash,
+		     hb = ((const struct entry*)b)->hash;
+	return ha < hb ? -1 : (ha > hb ? 1 : 0);
+}
+
+// the buffers of an empty writer are NULL
+static inline bool
+_write(const void* buf, size_t size, size_t count, FILE* fp) {
+	return count == 0 || fwrite(buf, size, count, fp) == count;
+}
+
+bool
+gtxt_disk_writer_save(struct gtxt_disk_writer* w, const char* filepath) {
+	uint64_t base = _records_offset(w->header.font_count, w->header.count);
+	if (base + w->records_sz > UINT32_MAX) {
+		return false;
+	}
+	for (uint32_t i = 0; i < w->header.count; ++i) {
+		w->entries[i].offset += (uint32_t)base;
+	}
+	if (w->header.count > 0) {
+		qsort(w->entries, w->header.count, sizeof(struct entry), _entry_cmp);
+	}
+
+	size_t path_len = strlen(filepath);
+	char* tmp_path = (char*)malloc(path_len + 5);
+	if (!tmp_path) {
+		return false;
+	}
+	memcpy(tmp_path, filepath, path_len);
+	memcpy(tmp_path + path_len, ".tmp", 5);
+
+	bool succ = false;
+	FILE* fp = fopen(tmp_path, "wb");
+	if (fp) {
+		static const uint8_t ZEROS[RECORD_ALIGN] = { 0 };
+		size_t head_sz = sizeof(struct header) + sizeof(uint64_t) * w->header.font_count + sizeof(struct entry) * w->header.count;
+		succ = _write(&w->header, sizeof(struct header), 1, fp)
+			&& _write(w->checksums, sizeof(uint64_t), w->header.font_count, fp)
+			&& _write(w->entries, sizeof(struct entry), w->header.count, fp)
+			&& _write(ZEROS, 1, (size_t)base - head_sz, fp)
+			&& _write(w->records, 1, w->records_sz, fp);
+		succ = fclose(fp) == 0 && succ;
+	}
+
+	if (succ) {
+#ifdef _WIN32
+		// fails while a reader still maps the file
+		succ = MoveFileExA(tmp_path, filepath, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		succ = rename(tmp_path, filepath) == 0;
+#endif
+	}
+	if (!succ) {
+		remove(tmp_path);
+	}
+	free(tmp_path);
+
+	// offsets back, the writer may be saved again
+	for (uint32_t i = 0; i < w->header.count; ++i) {
+		w->entries[i].offset -= (uint32_t)base;
+	}
+
+	return succ;
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifndef gametext_disk_h
+#define gametext_disk_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// read-only memory mapped file of records sorted by hash, each tagged with
+// the font it was made from and dropped when that font's checksum changes
+
+struct gtxt_disk;
+
+// format is defined by the caller and must match, flags are only stored
+struct gtxt_disk* gtxt_disk_open(const char* filepath, uint32_t format, const uint64_t* font_checksums, int font_count);
+void gtxt_disk_close(struct gtxt_disk*);
+
+uint32_t gtxt_disk_get_flags(struct gtxt_disk*);
+
+// records are 16 bytes aligned
+const void* gtxt_disk_query(struct gtxt_disk*, uint64_t hash, const void* key, bool (*equal)(const void* key, const void* record), size_t* size);
+
+int gtxt_disk_count(struct gtxt_disk*);
+// NULL if the record's font has changed
+const void* gtxt_disk_get(struct gtxt_disk*, int idx, uint64_t* hash, size_t* size);
+
+struct gtxt_disk_writer;
+
+struct gtxt_disk_writer* gtxt_disk_writer_create(uint32_t format, uint32_t flags, const uint64_t* font_checksums, int font_count);
+void gtxt_disk_writer_release(struct gtxt_disk_writer*);
+
+// the record is head followed by data
+bool gtxt_disk_writer_add(struct gtxt_disk_writer*, uint64_t hash, int font, const void* head, size_t head_sz, const void* data, size_t data_sz);
+// writes to a temporary file first, so a mapped file may be replaced; not
+// on windows, where readers of the file must be closed before
+bool gtxt_disk_writer_save(struct gtxt_disk_writer*, const char* filepath);
+
+#endif // gametext_disk_h
+
+#ifdef __cplusplus
+}
+#endif
\ No newline at end of file
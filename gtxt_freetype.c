@@ -1,6 +1,8 @@
 #include "gtxt_freetype.h"
 #include "gtxt_glyph.h"
 #include "gtxt_richtext.h"
+#include "gtxt_hash.h"
+#include "gtxt_thread.h"
 
 #include <fs_file.h>
 
@@ -9,23 +11,35 @@
 #include FT_GLYPH_H
 #include FT_IMAGE_H
 #include FT_STROKER_H
+#include FT_MODULE_H
 
 #include <assert.h>
 #include <math.h>
 
+// a font file in memory, shared by the faces made from it and freed with the
+// last of them, so a reload doesn't pull it from under another thread
+struct font_data {
+	int refs;
+	size_t sz;
+	unsigned char buf[1];
+};
+
 struct font {
-	FT_Library library;
-	FT_Face face;
-	unsigned char* buf;
+	struct font_data* data;
+	uint64_t checksum;
+	unsigned int generation;
 };
 
 #define MAX_FONTS 8
 
-//#define PREMULTIPLY_APLHA
-
 struct freetype {
 	struct font	fonts[MAX_FONTS];
 	int count;
+
+	bool premultiplied;
+
+	// guards the font data and its refs
+	gtxt_mutex lock;
 };
 
 static struct freetype* FT;
@@ -43,36 +57,172 @@ struct spans {
 	int sz;
 };
 
-static struct spans* IN_SPANS = NULL;
-static struct spans* OUT_SPANS = NULL;
+// FreeType objects and scratch buffers can't be shared between threads,
+// each thread rasterizes with the context bound to it, or the default one
+struct gtxt_ft_context {
+	FT_Library library;
+	FT_Face faces[MAX_FONTS];
+	// what each face was made from, replaced once the font is reloaded
+	struct font_data* datas[MAX_FONTS];
+
+	struct spans in_spans;
+	struct spans out_spans;
+
+	union gtxt_color* buf;
+	size_t buf_sz;
+
+	uint8_t* cov;
+	size_t cov_sz;
+	int cov_channels;
+
+	// where the glyph being drawn goes, NULL for buf or cov
+	const struct gtxt_ft_target* target;
+	uint8_t* dst;
+	int dst_stride;
+	bool dst_failed;
+
+	// of the sdf renderer, set per library
+	int sdf_spread;
+
+	// colors written, per context as other threads may draw meanwhile
+	bool premultiplied;
+};
+
+static struct gtxt_ft_context* DEFAULT_CTX;
+static GTXT_THREAD_LOCAL struct gtxt_ft_context* CTX;
+
+static inline struct gtxt_ft_context*
+_ctx() {
+	return CTX ? CTX : DEFAULT_CTX;
+}
+
+static struct font_data*
+_data_create(const char* filepath) {
+	struct fs_file* file = fs_open(filepath, "rb");
+	if (!file) {
+		return NULL;
+	}
+	size_t sz = fs_size(file);
+	struct font_data* data = (struct font_data*)malloc(sizeof(*data) + sz);
+	if (!data) {
+		fs_close(file);
+		return NULL;
+	}
+	if (fs_read(file, data->buf, sz) != sz) {
+		fs_close(file);
+		free(data);
+		return NULL;
+	}
+	fs_close(file);
+	data->refs = 1;
+	data->sz = sz;
+	return data;
+}
+
+// with FT->lock held
+static inline void
+_data_release(struct font_data* data) {
+	if (data && --data->refs == 0) {
+		free(data);
+	}
+}
+
+struct gtxt_ft_context*
+gtxt_ft_context_create() {
+	struct gtxt_ft_context* ctx = (struct gtxt_ft_context*)malloc(sizeof(*ctx));
+	if (!ctx) {
+		return NULL;
+	}
+	memset(ctx, 0, sizeof(*ctx));
+	if (FT_Init_FreeType(&ctx->library)) {
+		free(ctx);
+		return NULL;
+	}
+	return ctx;
+}
 
-static union gtxt_color* BUF;
-static size_t BUF_SZ;
+void
+gtxt_ft_context_release(struct gtxt_ft_context* ctx) {
+	if (!ctx) {
+		return;
+	}
+	gtxt_mutex_lock(&FT->lock);
+	for (int i = 0; i < MAX_FONTS; ++i) {
+		if (ctx->faces[i]) {
+			FT_Done_Face(ctx->faces[i]);
+		}
+		_data_release(ctx->datas[i]);
+	}
+	gtxt_mutex_unlock(&FT->lock);
+	FT_Done_FreeType(ctx->library);
+	free(ctx->buf);
+	free(ctx->cov);
+	free(ctx);
+}
+
+void
+gtxt_ft_context_bind(struct gtxt_ft_context* ctx) {
+	CTX = ctx;
+}
+
+// faces share the font file in memory, a face of a reloaded font is made
+// again on its context's next glyph
+static inline FT_Face
+_get_face(struct gtxt_ft_context* ctx, int font) {
+	struct font* f = &FT->fonts[font];
+	gtxt_mutex_lock(&FT->lock);
+	if (ctx->datas[font] != f->data) {
+		if (ctx->faces[font]) {
+			FT_Done_Face(ctx->faces[font]);
+			ctx->faces[font] = NULL;
+		}
+		_data_release(ctx->datas[font]);
+		ctx->datas[font] = NULL;
+
+		struct font_data* data = f->data;
+		if (data && !FT_New_Memory_Face(ctx->library, (const FT_Byte*)data->buf, data->sz, 0, &ctx->faces[font])) {
+			ctx->datas[font] = data;
+			++data->refs;
+		} else {
+			ctx->faces[font] = NULL;
+		}
+	}
+	gtxt_mutex_unlock(&FT->lock);
+	return ctx->faces[font];
+}
 
 void
 gtxt_ft_create() {
 	FT = (struct freetype*)malloc(sizeof(*FT));
 	memset(FT, 0, sizeof(*FT));
+	gtxt_mutex_init(&FT->lock);
 
-	IN_SPANS = (struct spans*)malloc(sizeof(struct spans));
-	memset(IN_SPANS, 0, sizeof(*IN_SPANS));
-	OUT_SPANS = (struct spans*)malloc(sizeof(struct spans));
-	memset(OUT_SPANS, 0, sizeof(*OUT_SPANS));
+	DEFAULT_CTX = gtxt_ft_context_create();
 }
 
 void
 gtxt_ft_release() {
+	gtxt_ft_context_release(DEFAULT_CTX); DEFAULT_CTX = NULL;
 	for (int i = 0; i < FT->count; ++i) {
-		struct font* f = &FT->fonts[i];
-		FT_Done_Face(f->face);
-		FT_Done_FreeType(f->library);
-		free(f->buf);
+		_data_release(FT->fonts[i].data);
 	}
+	gtxt_mutex_release(&FT->lock);
 	free(FT); FT = NULL;
-	free(IN_SPANS); IN_SPANS = NULL;
-	free(OUT_SPANS); OUT_SPANS = NULL;
-	free(BUF); BUF = NULL;
-	BUF_SZ = 0;
+}
+
+static uint64_t
+_checksum(const unsigned char* buf, size_t sz) {
+	uint64_t h = sz;
+	size_t i = 0;
+	for ( ; i + sizeof(uint64_t) <= sz; i += sizeof(uint64_t)) {
+		uint64_t v;
+		memcpy(&v, buf + i, sizeof(v));
+		h = gtxt_hash_mix(h, v);
+	}
+	for ( ; i < sz; ++i) {
+		h = gtxt_hash_mix(h, buf[i]);
+	}
+	return gtxt_hash_finish(h);
 }
 
 int
@@ -81,33 +231,74 @@ gtxt_ft_add_font(const char* name, const char* filepath) {
 		return -1;
 	}
 
-	struct font* f = &FT->fonts[FT->count++];
+	int idx = FT->count++;
+	struct font* f = &FT->fonts[idx];
 
-	if (FT_Init_FreeType(&f->library)) {
+	f->data = _data_create(filepath);
+	if (!f->data) {
 		return -1;
 	}
 
-	struct fs_file* file = fs_open(filepath, "rb");
-	if (!file) {
+	if (!_get_face(DEFAULT_CTX, idx)) {
+		gtxt_mutex_lock(&FT->lock);
+		_data_release(f->data); f->data = NULL;
+		gtxt_mutex_unlock(&FT->lock);
 		return -1;
 	}
-	size_t sz = fs_size(file);
-	f->buf = (unsigned char*)malloc(sz);
 
-	if (fs_read(file, f->buf, sz) != sz) {
-		free(f->buf);
-		return -1;
+	f->checksum = _checksum(f->data->buf, f->data->sz);
+
+	gtxt_richtext_add_font(name);
+
+	return idx;
+}
+
+bool
+gtxt_ft_reload_font(int font, const char* filepath) {
+	if (font < 0 || font >= FT->count) {
+		return false;
 	}
-	fs_close(file);
 
-	if (FT_New_Memory_Face(f->library, (const FT_Byte*)f->buf, sz, 0, &f->face)) {
-		free(f->buf);
-		return -1;
+	struct font_data* data = _data_create(filepath);
+	if (!data) {
+		return false;
 	}
 
-	gtxt_richtext_add_font(name);
+	// checked with a library of its own, the contexts may be in use
+	FT_Library library;
+	if (FT_Init_FreeType(&library)) {
+		free(data);
+		return false;
+	}
+	FT_Face face;
+	bool valid = !FT_New_Memory_Face(library, (const FT_Byte*)data->buf, data->sz, 0, &face);
+	if (valid) {
+		FT_Done_Face(face);
+	}
+	FT_Done_FreeType(library);
+	if (!valid) {
+		free(data);
+		return false;
+	}
 
-	return FT->count - 1;
+	struct font* f = &FT->fonts[font];
+	uint64_t checksum = _checksum(data->buf, data->sz);
+	gtxt_mutex_lock(&FT->lock);
+	_data_release(f->data);
+	f->data = data;
+	f->checksum = checksum;
+	++f->generation;
+	gtxt_mutex_unlock(&FT->lock);
+
+	return true;
+}
+
+unsigned int
+gtxt_ft_get_font_generation(int font) {
+	if (font < 0 || font >= FT->count) {
+		return 0;
+	}
+	return FT->fonts[font].generation;
 }
 
 int
@@ -115,11 +306,33 @@ gtxt_ft_get_font_cout() {
 	return FT->count;
 }
 
+uint64_t
+gtxt_ft_get_font_checksum(int font) {
+	if (font < 0 || font >= FT->count) {
+		return 0;
+	}
+	return FT->fonts[font].checksum;
+}
+
+void
+gtxt_ft_set_premultiplied(bool premultiplied) {
+	FT->premultiplied = premultiplied;
+	DEFAULT_CTX->premultiplied = premultiplied;
+}
+
+void
+gtxt_ft_context_set_premultiplied(struct gtxt_ft_context* ctx, bool premultiplied) {
+	ctx->premultiplied = premultiplied;
+}
+
+bool
+gtxt_ft_is_premultiplied() {
+	return FT->premultiplied;
+}
+
 static bool
-_draw_default(struct font* font, FT_UInt gindex, float line_x, const struct gtxt_glyph_color* color, struct gtxt_glyph_layout* layout,
+_draw_default(FT_Face ft_face, FT_UInt gindex, float line_x, const struct gtxt_glyph_color* color, struct gtxt_glyph_layout* layout,
 			  void (*cb)(FT_Bitmap* bitmap, float line_x, const struct gtxt_glyph_color* color)) {
-	FT_Face ft_face = font->face;
-
 	if (FT_Load_Glyph(ft_face, gindex, FT_LOAD_DEFAULT)) {
 		return false;
 	}
@@ -153,7 +366,7 @@ _draw_default(struct font* font, FT_UInt gindex, float line_x, const struct gtxt
 	return true;
 }
 
-static int span_max = 0;
+static GTXT_THREAD_LOCAL int span_max = 0;
 
 static inline void
 _raster_cb(const int y, const int count, const FT_Span * const spans, void * const user) {
@@ -212,11 +425,10 @@ _rect_height(struct rect* r) {
 }
 
 static bool
-_draw_with_edge(struct font* font, FT_UInt gindex, float line_x, const struct gtxt_glyph_color* font_color,
+_draw_with_edge(struct gtxt_ft_context* ctx, FT_Face ft_face, FT_UInt gindex, float line_x, const struct gtxt_glyph_color* font_color,
 				float edge_size, const struct gtxt_glyph_color* edge_color, struct gtxt_glyph_layout* layout,
 				void (*cb)(int img_x, int img_y, int img_w, int img_h, float line_x, const struct gtxt_glyph_color* font_color, const struct gtxt_glyph_color* edge_color)) {
-	FT_Face ft_face = font->face;
-	FT_Library ft_library = font->library;
+	FT_Library ft_library = ctx->library;
 
 	if (FT_Load_Glyph(ft_face, gindex, FT_LOAD_NO_BITMAP)) {
 		return false;
@@ -227,11 +439,13 @@ _draw_with_edge(struct font* font, FT_UInt gindex, float line_x, const struct gt
 	}
 
 	// Render the basic glyph to a span list.
-	memset(IN_SPANS, 0, sizeof(*IN_SPANS));
-	_draw_spans(ft_library, &ft_face->glyph->outline, IN_SPANS);
+	struct spans* in_spans = &ctx->in_spans;
+	struct spans* out_spans = &ctx->out_spans;
+	memset(in_spans, 0, sizeof(*in_spans));
+	_draw_spans(ft_library, &ft_face->glyph->outline, in_spans);
 
 	// Next we need the spans for the outline.
-	memset(OUT_SPANS, 0, sizeof(*OUT_SPANS));
+	memset(out_spans, 0, sizeof(*out_spans));
 
 	// Set up a stroker.
 	FT_Stroker stroker;
@@ -257,28 +471,28 @@ _draw_with_edge(struct font* font, FT_UInt gindex, float line_x, const struct gt
 	{
 		// Render the outline spans to the span list
 		FT_Outline *o = &((FT_OutlineGlyph)glyph)->outline;
-		_draw_spans(ft_library, o, OUT_SPANS);
+		_draw_spans(ft_library, o, out_spans);
 	}
 
 	// Clean up afterwards.
 	FT_Stroker_Done(stroker);
 	FT_Done_Glyph(glyph);
 
-	if (IN_SPANS->sz == 0) {
+	if (in_spans->sz == 0) {
 		layout->sizer.width = layout->sizer.height = 0;
 		return false;
 	}
 
 	struct rect rect;
-	rect.xmin = rect.xmax = (float)IN_SPANS->items[0].x;
-	rect.ymin = rect.ymax = (float)IN_SPANS->items[0].y;
-	for (int i = 0; i < IN_SPANS->sz; ++i) {
-		struct span* s = &IN_SPANS->items[i];
+	rect.xmin = rect.xmax = (float)in_spans->items[0].x;
+	rect.ymin = rect.ymax = (float)in_spans->items[0].y;
+	for (int i = 0; i < in_spans->sz; ++i) {
+		struct span* s = &in_spans->items[i];
 		_rect_merge_point(&rect, (float)s->x, (float)s->y);
 		_rect_merge_point(&rect, (float)(s->x + s->width - 1), (float)s->y);
 	}
-	for (int i = 0; i < OUT_SPANS->sz; ++i) {
-		struct span* s = &OUT_SPANS->items[i];
+	for (int i = 0; i < out_spans->sz; ++i) {
+		struct span* s = &out_spans->items[i];
 		_rect_merge_point(&rect, (float)s->x, (float)s->y);
 		_rect_merge_point(&rect, (float)(s->x + s->width - 1), (float)s->y);
 	}
@@ -303,6 +517,22 @@ _draw_with_edge(struct font* font, FT_UInt gindex, float line_x, const struct gt
 	return true;
 }
 
+static inline FT_UInt
+_get_char_index(FT_Face ft_face, int* unicode) {
+	FT_UInt gindex = FT_Get_Char_Index(ft_face, *unicode);
+	if (gindex == 0) {
+		const int DEFAULT_UNICODE = 9633;
+		*unicode = DEFAULT_UNICODE;
+		gindex = FT_Get_Char_Index(ft_face, *unicode);
+	}
+	return gindex;
+}
+
+static inline bool
+_is_blank(int unicode) {
+	return unicode == ' ' || unicode == 160 || unicode == '\n';
+}
+
 static bool
 _load_glyph_to_bitmap(int unicode, float line_x, const struct gtxt_glyph_style* style, struct gtxt_glyph_layout* layout,
 					  void (*default_cb)(FT_Bitmap* bitmap, float line_x, const struct gtxt_glyph_color* color),
@@ -311,44 +541,87 @@ _load_glyph_to_bitmap(int unicode, float line_x, const struct gtxt_glyph_style*
 		return false;
 	}
 
-	struct font* sfont = &FT->fonts[style->font];
-	FT_Face ft_face = sfont->face;
-	assert(ft_face);
+	struct gtxt_ft_context* ctx = _ctx();
+	FT_Face ft_face = _get_face(ctx, style->font);
+	if (!ft_face) {
+		return false;
+	}
 
 	FT_Set_Pixel_Sizes(ft_face, style->font_size, style->font_size);
 	FT_Size_Metrics s = ft_face->size->metrics;
 	layout->metrics_height = (float)(s.height >> 6);
 
-	FT_UInt gindex = FT_Get_Char_Index(ft_face, unicode);
-	if (gindex == 0) {
-		const int DEFAULT_UNICODE = 9633;
-		unicode = DEFAULT_UNICODE;
-		gindex = FT_Get_Char_Index(ft_face, unicode);
-	}
-
-	if (unicode == ' ' || unicode == 160 || unicode == '\n') {
+	FT_UInt gindex = _get_char_index(ft_face, &unicode);
+	if (_is_blank(unicode)) {
 		edge_cb = NULL;
 		default_cb = NULL;
 	}
 	if (style->edge) {
-		return _draw_with_edge(sfont, gindex, line_x, &style->font_color,
+		return _draw_with_edge(ctx, ft_face, gindex, line_x, &style->font_color,
 			style->edge_size, &style->edge_color, layout, edge_cb);
 	} else {
-		return _draw_default(sfont, gindex, line_x, &style->font_color, layout, default_cb);
+		return _draw_default(ft_face, gindex, line_x, &style->font_color, layout, default_cb);
 	}
 }
 
-static inline void
-_prepare_buf(int sz) {
-	if (BUF_SZ < (size_t)sz) {
-		free(BUF);
-		BUF = malloc(sz);
-		if (!BUF) {
-			return;
+static inline union gtxt_color*
+_prepare_buf(struct gtxt_ft_context* ctx, int sz) {
+	if (ctx->buf_sz < (size_t)sz) {
+		free(ctx->buf);
+		ctx->buf = malloc(sz);
+		if (!ctx->buf) {
+			ctx->buf_sz = 0;
+			return NULL;
 		}
-		BUF_SZ = sz;
+		ctx->buf_sz = sz;
 	}
-	memset(BUF, 0, sz);
+	return ctx->buf;
+}
+
+static inline uint8_t*
+_prepare_cov(struct gtxt_ft_context* ctx, int sz) {
+	if (ctx->cov_sz < (size_t)sz) {
+		free(ctx->cov);
+		ctx->cov = malloc(sz);
+		if (!ctx->cov) {
+			ctx->cov_sz = 0;
+			return NULL;
+		}
+		ctx->cov_sz = sz;
+	}
+	return ctx->cov;
+}
+
+// only cleared when not every pixel is written
+static inline uint8_t*
+_prepare_dst(struct gtxt_ft_context* ctx, int w, int h, int bpp, bool clear) {
+	if (w <= 0 || h <= 0) {
+		return NULL;
+	}
+
+	uint8_t* dst = NULL;
+	int stride = w * bpp;
+	if (ctx->target) {
+		dst = (uint8_t*)ctx->target->alloc(w, h, bpp, &stride, ctx->target->ud);
+	} else if (bpp == sizeof(union gtxt_color)) {
+		dst = (uint8_t*)_prepare_buf(ctx, w * h * bpp);
+	} else {
+		dst = _prepare_cov(ctx, w * h * bpp);
+	}
+
+	ctx->dst = dst;
+	ctx->dst_stride = stride;
+	if (!dst) {
+		ctx->dst_failed = true;
+		return NULL;
+	}
+
+	if (clear) {
+		for (int y = 0; y < h; ++y) {
+			memset(dst + (size_t)y * stride, 0, (size_t)w * bpp);
+		}
+	}
+	return dst;
 }
 
 static inline union gtxt_color
@@ -411,32 +684,59 @@ _lerp_color(const struct gtxt_glyph_color* col, float line_x, int w, int h, int
 	return ret;
 }
 
+// x * a / 255, rounded
+static inline uint8_t
+_mul8(int x, int a) {
+	int t = x * a + 128;
+	return (uint8_t)((t + (t >> 8)) >> 8);
+}
+
+static inline void
+_set_pixel(union gtxt_color* dst, union gtxt_color src, uint8_t a, bool premultiplied) {
+	if (premultiplied) {
+		dst->r = _mul8(src.r, a);
+		dst->g = _mul8(src.g, a);
+		dst->b = _mul8(src.b, a);
+	} else {
+		dst->r = src.r;
+		dst->g = src.g;
+		dst->b = src.b;
+	}
+	dst->a = a;
+}
+
+// font over edge
+static inline void
+_blend_pixel(union gtxt_color* dst, union gtxt_color src, uint8_t a, bool premultiplied) {
+	if (premultiplied) {
+		int inv = 255 - a;
+		dst->r = _mul8(src.r, a) + _mul8(dst->r, inv);
+		dst->g = _mul8(src.g, a) + _mul8(dst->g, inv);
+		dst->b = _mul8(src.b, a) + _mul8(dst->b, inv);
+		dst->a = a + _mul8(dst->a, inv);
+	} else {
+		dst->r = src.r;
+		dst->g = src.g;
+		dst->b = src.b;
+		dst->a = a;
+	}
+}
+
 static inline void
 _copy_glyph_default(FT_Bitmap* bitmap, float line_x, const struct gtxt_glyph_color* color) {
-	int sz = sizeof(struct gtxt_glyph_color) * bitmap->rows * bitmap->width;
-	_prepare_buf(sz);
+	struct gtxt_ft_context* ctx = _ctx();
+	uint8_t* buf = _prepare_dst(ctx, bitmap->width, bitmap->rows, sizeof(union gtxt_color), false);
+	if (!buf) {
+		return;
+	}
 
-	int ptr = 0;
 	for (size_t i = 0; i < bitmap->rows; ++i) {
+		int y = bitmap->rows - 1 - i;
+		const uint8_t* src = bitmap->buffer + i * bitmap->pitch;
+		union gtxt_color* dst = (union gtxt_color*)(buf + (size_t)y * ctx->dst_stride);
 		for (size_t j = 0; j < bitmap->width; ++j) {
-			int x = j;
-			int y = bitmap->rows - 1 - i;
-			union gtxt_color src = _lerp_color(color, line_x, bitmap->width, bitmap->rows, x, y);
-			int dst_ptr = y * bitmap->width + x;
-			union gtxt_color* dst = &BUF[dst_ptr];
-			uint8_t a = bitmap->buffer[ptr];
-#ifdef PREMULTIPLY_APLHA
-			dst->r = (src.r * a) >> 8;
-			dst->g = (src.g * a) >> 8;
-			dst->b = (src.b * a) >> 8;
-			dst->a = 255;
-#else
-			dst->r = src.r;
-			dst->g = src.g;
-			dst->b = src.b;
-			dst->a = a;
-#endif // PREMULTIPLY_APLHA
-			++ptr;
+			union gtxt_color col = _lerp_color(color, line_x, bitmap->width, bitmap->rows, j, y);
+			_set_pixel(&dst[j], col, src[j], ctx->premultiplied);
 		}
 	}
 }
@@ -444,61 +744,93 @@ _copy_glyph_default(FT_Bitmap* bitmap, float line_x, const struct gtxt_glyph_col
 static inline void
 _copy_glyph_with_edge(int img_x, int img_y, int img_w, int img_h, float line_x,
                       const struct gtxt_glyph_color* font_color, const struct gtxt_glyph_color* edge_color) {
-	int sz = sizeof(struct gtxt_glyph_color) * img_w * img_h;
-	_prepare_buf(sz);
+	struct gtxt_ft_context* ctx = _ctx();
+	uint8_t* buf = _prepare_dst(ctx, img_w, img_h, sizeof(union gtxt_color), true);
+	if (!buf) {
+		return;
+	}
 
 	// Loop over the outline spans and just draw them into the
 	// image.
-	int h = abs(OUT_SPANS->items[OUT_SPANS->sz - 1].y);
-	for (int i = 0; i < OUT_SPANS->sz; ++i) {
-		struct span* out_span = &OUT_SPANS->items[i];
+	for (int i = 0; i < ctx->out_spans.sz; ++i) {
+		struct span* out_span = &ctx->out_spans.items[i];
+		if (out_span->coverage == 0) {
+			continue;
+		}
 		for (int w = 0; w < out_span->width; ++w) {
 			int x = out_span->x - img_x + w;
 			int y = out_span->y - img_y;
 			union gtxt_color src = _lerp_color(edge_color, line_x, img_w, img_h, x, y);
-			int index = (int)(y * img_w + x);
-			union gtxt_color* dst = &BUF[index];
-			uint8_t a = out_span->coverage;
-#ifdef PREMULTIPLY_APLHA
-			dst->r = (src.r * a) >> 8;
-			dst->g = (src.g * a) >> 8;
-			dst->b = (src.b * a) >> 8;
-			dst->a = 255;
-#else
-			dst->r = src.r;
-			dst->g = src.g;
-			dst->b = src.b;
-			dst->a = a;
-#endif // PREMULTIPLY_APLHA
+			union gtxt_color* dst = (union gtxt_color*)(buf + (size_t)y * ctx->dst_stride) + x;
+			_set_pixel(dst, src, out_span->coverage, ctx->premultiplied);
 		}
 	}
 
 	// Then loop over the regular glyph spans and blend them into
 	// the image.
-	for (int i = 0; i < IN_SPANS->sz; ++i) {
-		struct span* s = &IN_SPANS->items[i];
+	for (int i = 0; i < ctx->in_spans.sz; ++i) {
+		struct span* s = &ctx->in_spans.items[i];
+		// empty span would punch a hole in the edge
+		if (s->coverage == 0) {
+			continue;
+		}
 		for (int w = 0; w < s->width; ++w) {
 			int x = s->x - img_x + w;
 			int y = s->y - img_y;
 			union gtxt_color src = _lerp_color(font_color, line_x, img_w, img_h, x, y);
-			int index = y * img_w + x;
-			union gtxt_color* dst = &BUF[index];
-			uint8_t a = s->coverage;
-#ifdef PREMULTIPLY_APLHA
-			//dst->r = (src.r * a) >> 8;
-			//dst->g = (src.g * a) >> 8;
-			//dst->b = (src.b * a) >> 8;
-			//dst->a = a;
-			dst->r = (int)(dst->r + ((src.r - dst->r) * a) / 255.0f);
-			dst->g = (int)(dst->g + ((src.g - dst->g) * a) / 255.0f);
-			dst->b = (int)(dst->b + ((src.b - dst->b) * a) / 255.0f);
-			dst->a = 255;
-#else
-			dst->r = src.r;
-			dst->g = src.g;
-			dst->b = src.b;
-			dst->a = a;
-#endif // PREMULTIPLY_APLHA
+			union gtxt_color* dst = (union gtxt_color*)(buf + (size_t)y * ctx->dst_stride) + x;
+			_blend_pixel(dst, src, s->coverage, ctx->premultiplied);
+		}
+	}
+}
+
+static inline void
+_copy_coverage_default(FT_Bitmap* bitmap, float line_x, const struct gtxt_glyph_color* color) {
+	// color is applied when emitting
+	(void)line_x;
+	(void)color;
+	struct gtxt_ft_context* ctx = _ctx();
+	int channels = ctx->cov_channels;
+	uint8_t* cov = _prepare_dst(ctx, bitmap->width, bitmap->rows, channels, channels > 1);
+	if (!cov) {
+		return;
+	}
+
+	for (size_t i = 0; i < bitmap->rows; ++i) {
+		int y = bitmap->rows - 1 - i;
+		const uint8_t* src = bitmap->buffer + i * bitmap->pitch;
+		uint8_t* dst = cov + (size_t)y * ctx->dst_stride;
+		for (size_t j = 0; j < bitmap->width; ++j) {
+			dst[j * channels] = src[j];
+		}
+	}
+}
+
+static inline void
+_copy_coverage_with_edge(int img_x, int img_y, int img_w, int img_h, float line_x,
+                         const struct gtxt_glyph_color* font_color, const struct gtxt_glyph_color* edge_color) {
+	(void)line_x;
+	(void)font_color;
+	(void)edge_color;
+	struct gtxt_ft_context* ctx = _ctx();
+	assert(ctx->cov_channels == 2);
+	uint8_t* cov = _prepare_dst(ctx, img_w, img_h, 2, true);
+	if (!cov) {
+		return;
+	}
+
+	for (int i = 0; i < ctx->out_spans.sz; ++i) {
+		struct span* s = &ctx->out_spans.items[i];
+		uint8_t* dst = cov + (size_t)(s->y - img_y) * ctx->dst_stride + (s->x - img_x) * 2;
+		for (int w = 0; w < s->width; ++w) {
+			dst[w * 2 + 1] = s->coverage;
+		}
+	}
+	for (int i = 0; i < ctx->in_spans.sz; ++i) {
+		struct span* s = &ctx->in_spans.items[i];
+		uint8_t* dst = cov + (size_t)(s->y - img_y) * ctx->dst_stride + (s->x - img_x) * 2;
+		for (int w = 0; w < s->width; ++w) {
+			dst[w * 2] = s->coverage;
 		}
 	}
 }
@@ -508,11 +840,267 @@ gtxt_ft_get_layout(int unicode, float line_x, const struct gtxt_glyph_style* sty
 	_load_glyph_to_bitmap(unicode, line_x, style, layout, NULL, NULL);
 }
 
+static inline void
+_begin_target(struct gtxt_ft_context* ctx, const struct gtxt_ft_target* target) {
+	ctx->target = target;
+	ctx->dst = NULL;
+	ctx->dst_stride = 0;
+	ctx->dst_failed = false;
+}
+
+bool
+gtxt_ft_gen_char_to(int unicode, float line_x, const struct gtxt_glyph_style* style, struct gtxt_glyph_layout* layout, const struct gtxt_ft_target* target) {
+	if (FT->count == 0) {
+		return false;
+	}
+	struct gtxt_ft_context* ctx = _ctx();
+	_begin_target(ctx, target);
+	bool succ = _load_glyph_to_bitmap(unicode, line_x, style, layout, _copy_glyph_default, _copy_glyph_with_edge);
+	ctx->target = NULL;
+	return succ && !ctx->dst_failed;
+}
+
 uint32_t*
 gtxt_ft_gen_char(int unicode, float line_x, const struct gtxt_glyph_style* style, struct gtxt_glyph_layout* layout) {
-	if (FT->count == 0) {
+	bool succ = gtxt_ft_gen_char_to(unicode, line_x, style, layout, NULL);
+	return succ ? (uint32_t*)_ctx()->buf : NULL;
+}
+
+bool
+gtxt_ft_gen_coverage_to(int unicode, const struct gtxt_glyph_style* style, struct gtxt_glyph_layout* layout, int channels, const struct gtxt_ft_target* target) {
+	if (FT->count == 0 || (style->edge && channels < 2)) {
+		return false;
+	}
+	struct gtxt_ft_context* ctx = _ctx();
+	ctx->cov_channels = channels;
+	_begin_target(ctx, target);
+	bool succ = _load_glyph_to_bitmap(unicode, 0, style, layout, _copy_coverage_default, _copy_coverage_with_edge);
+	ctx->target = NULL;
+	return succ && !ctx->dst_failed;
+}
+
+uint8_t*
+gtxt_ft_gen_coverage(int unicode, const struct gtxt_glyph_style* style, struct gtxt_glyph_layout* layout, int channels) {
+	bool succ = gtxt_ft_gen_coverage_to(unicode, style, layout, channels, NULL);
+	return succ ? _ctx()->cov : NULL;
+}
+
+static FT_Face
+_load_sdf_glyph(struct gtxt_ft_context* ctx, int* unicode, int font, int ref_size) {
+	if (font < 0 || font >= FT->count) {
 		return NULL;
 	}
-	bool succ = _load_glyph_to_bitmap(unicode, line_x, style, layout, _copy_glyph_default, _copy_glyph_with_edge);
-	return succ ? (uint32_t*)BUF : NULL;
+	FT_Face ft_face = _get_face(ctx, font);
+	if (!ft_face) {
+		return NULL;
+	}
+
+	FT_Set_Pixel_Sizes(ft_face, ref_size, ref_size);
+	FT_UInt gindex = _get_char_index(ft_face, unicode);
+	// unhinted, the field is scaled to other sizes
+	if (FT_Load_Glyph(ft_face, gindex, FT_LOAD_NO_HINTING | FT_LOAD_NO_BITMAP)) {
+		return NULL;
+	}
+	return ft_face;
 }
+
+static void
+_sdf_layout(FT_Face ft_face, int spread, bool blank, struct gtxt_glyph_layout* layout) {
+	FT_Glyph_Metrics gm = ft_face->glyph->metrics;
+	// pixel bounds of the outline, as the renderer rounds them
+	int x0 = (int)(gm.horiBearingX >> 6),
+		x1 = (int)((gm.horiBearingX + gm.width + 63) >> 6),
+		y0 = (int)((gm.horiBearingY - gm.height) >> 6),
+		y1 = (int)((gm.horiBearingY + 63) >> 6);
+	if (blank || x1 <= x0 || y1 <= y0) {
+		layout->sizer.width = layout->sizer.height = 0;
+		layout->bearing_x = (float)x0;
+		layout->bearing_y = (float)y1;
+	} else {
+		layout->sizer.width = (float)(x1 - x0 + spread * 2);
+		layout->sizer.height = (float)(y1 - y0 + spread * 2);
+		layout->bearing_x = (float)(x0 - spread);
+		layout->bearing_y = (float)(y1 + spread);
+	}
+	layout->advance = gm.horiAdvance / 64.0f;
+	layout->metrics_height = ft_face->size->metrics.height / 64.0f;
+}
+
+void
+gtxt_ft_get_sdf_layout(int unicode, int font, int ref_size, int spread, struct gtxt_glyph_layout* layout) {
+	FT_Face ft_face = _load_sdf_glyph(_ctx(), &unicode, font, ref_size);
+	if (ft_face) {
+		_sdf_layout(ft_face, spread, _is_blank(unicode), layout);
+	}
+}
+
+bool
+gtxt_ft_gen_sdf_to(int unicode, int font, int ref_size, int spread, struct gtxt_glyph_layout* layout, const struct gtxt_ft_target* target) {
+	struct gtxt_ft_context* ctx = _ctx();
+	FT_Face ft_face = _load_sdf_glyph(ctx, &unicode, font, ref_size);
+	if (!ft_face || ft_face->glyph->format != FT_GLYPH_FORMAT_OUTLINE) {
+		return false;
+	}
+
+	bool blank = _is_blank(unicode);
+	_sdf_layout(ft_face, spread, blank, layout);
+	if (blank || layout->sizer.width == 0) {
+		return true;
+	}
+
+	if (ctx->sdf_spread != spread) {
+		if (FT_Property_Set(ctx->library, "sdf", "spread", &spread)) {
+			return false;
+		}
+		ctx->sdf_spread = spread;
+	}
+	if (FT_Render_Glyph(ft_face->glyph, FT_RENDER_MODE_SDF)) {
+		return false;
+	}
+
+	FT_GlyphSlot slot = ft_face->glyph;
+	FT_Bitmap* bitmap = &slot->bitmap;
+	layout->sizer.width = (float)bitmap->width;
+	layout->sizer.height = (float)bitmap->rows;
+	layout->bearing_x = (float)slot->bitmap_left;
+	layout->bearing_y = (float)slot->bitmap_top;
+
+	_begin_target(ctx, target);
+	uint8_t* dst = _prepare_dst(ctx, bitmap->width, bitmap->rows, 1, false);
+	ctx->target = NULL;
+	for (size_t i = 0; dst && i < bitmap->rows; ++i) {
+		int y = bitmap->rows - 1 - i;
+		memcpy(dst + (size_t)y * ctx->dst_stride, bitmap->buffer + i * bitmap->pitch, bitmap->width);
+	}
+	return !ctx->dst_failed;
+}
+
+uint8_t*
+gtxt_ft_gen_sdf(int unicode, int font, int ref_size, int spread, struct gtxt_glyph_layout* layout) {
+	bool succ = gtxt_ft_gen_sdf_to(unicode, font, ref_size, spread, layout, NULL);
+	return succ ? _ctx()->cov : NULL;
+}
+
+static inline float
+_sdf_sample(const uint8_t* sdf, int w, int h, float fx, float fy) {
+	fx = MIN(w - 1, MAX(fx, 0));
+	fy = MIN(h - 1, MAX(fy, 0));
+	int x0 = (int)fx, y0 = (int)fy;
+	int x1 = MIN(w - 1, x0 + 1), y1 = MIN(h - 1, y0 + 1);
+	float tx = fx - x0, ty = fy - y0;
+	float v0 = sdf[y0 * w + x0] + (sdf[y0 * w + x1] - sdf[y0 * w + x0]) * tx;
+	float v1 = sdf[y1 * w + x0] + (sdf[y1 * w + x1] - sdf[y1 * w + x0]) * tx;
+	return v0 + (v1 - v0) * ty;
+}
+
+static inline uint8_t
+_sdf_coverage(float dist) {
+	float c = dist + 0.5f;
+	return (uint8_t)(MIN(1, MAX(c, 0)) * 255 + 0.5f);
+}
+
+void
+gtxt_ft_sdf_to_coverage(const uint8_t* sdf, int sdf_w, int sdf_h, int spread, float scale, float edge_size,
+                        uint8_t* dst, int w, int h, int channels) {
+	// 128 is the outline, the field is spread pixels either way
+	float unit = spread * scale / 128.0f;
+	for (int y = 0; y < h; ++y) {
+		float fy = spread + (y + 0.5f - edge_size) / scale - 0.5f;
+		for (int x = 0; x < w; ++x) {
+			float fx = spread + (x + 0.5f - edge_size) / scale - 0.5f;
+			float dist = (_sdf_sample(sdf, sdf_w, sdf_h, fx, fy) - 128) * unit;
+			uint8_t* d = &dst[(y * w + x) * channels];
+			d[0] = _sdf_coverage(dist);
+			if (channels > 1) {
+				d[1] = _sdf_coverage(dist + edge_size);
+			}
+		}
+	}
+}
+
+void
+gtxt_ft_colorize(const uint8_t* coverage, int channels, int w, int h, float line_x, const struct gtxt_glyph_style* style,
+				 bool premultiplied, uint32_t* dst) {
+	union gtxt_color* buf = (union gtxt_color*)dst;
+	bool edge = style->edge && channels > 1;
+	for (int y = 0; y < h; ++y) {
+		for (int x = 0; x < w; ++x) {
+			const uint8_t* c = &coverage[(y * w + x) * channels];
+			union gtxt_color* d = &buf[y * w + x];
+			if (!edge) {
+				_set_pixel(d, _lerp_color(&style->font_color, line_x, w, h, x, y), c[0], premultiplied);
+				continue;
+			}
+			d->integer = 0;
+			if (c[1]) {
+				_set_pixel(d, _lerp_color(&style->edge_color, line_x, w, h, x, y), c[1], premultiplied);
+			}
+			if (c[0]) {
+				_blend_pixel(d, _lerp_color(&style->font_color, line_x, w, h, x, y), c[0], premultiplied);
+			}
+		}
+	}
+}
+
+void
+gtxt_ft_premultiply(uint32_t* pixels, int count) {
+	union gtxt_color* p = (union gtxt_color*)pixels;
+	for (int i = 0; i < count; ++i) {
+		p[i].r = _mul8(p[i].r, p[i].a);
+		p[i].g = _mul8(p[i].g, p[i].a);
+		p[i].b = _mul8(p[i].b, p[i].a);
+	}
+}
+
+static inline union gtxt_color
+_unpremultiply(union gtxt_color c) {
+	if (c.a != 0 && c.a != 255) {
+		c.r = (uint8_t)MIN(255, (c.r * 255 + c.a / 2) / c.a);
+		c.g = (uint8_t)MIN(255, (c.g * 255 + c.a / 2) / c.a);
+		c.b = (uint8_t)MIN(255, (c.b * 255 + c.a / 2) / c.a);
+	}
+	return c;
+}
+
+void
+gtxt_ft_convert(const uint32_t* src, int w, int h, bool src_premultiplied, const struct gtxt_glyph_output* out, void* dst) {
+	int bpp = gtxt_glyph_format_bpp(out->format);
+	int stride = out->stride > 0 ? out->stride : w * bpp;
+	for (int y = 0; y < h; ++y) {
+		// the source is bottom-up
+		const union gtxt_color* s = (const union gtxt_color*)src + (out->top_down ? h - 1 - y : y) * w;
+		uint8_t* d = (uint8_t*)dst + (size_t)y * stride;
+		for (int x = 0; x < w; ++x) {
+			union gtxt_color c = s[x];
+			switch (out->format)
+			{
+			case GTXT_GLYPH_RGBA:
+				if (src_premultiplied) {
+					c = _unpremultiply(c);
+				}
+				memcpy(d + x * 4, &c, 4);
+				break;
+			case GTXT_GLYPH_RGBA_PREMUL:
+				if (!src_premultiplied) {
+					c.r = _mul8(c.r, c.a);
+					c.g = _mul8(c.g, c.a);
+					c.b = _mul8(c.b, c.a);
+				}
+				memcpy(d + x * 4, &c, 4);
+				break;
+			case GTXT_GLYPH_A8:
+				d[x] = c.a;
+				break;
+			case GTXT_GLYPH_LA8:
+				if (src_premultiplied) {
+					c = _unpremultiply(c);
+				}
+				d[x * 2] = (uint8_t)((c.r * 77 + c.g * 150 + c.b * 29) >> 8);
+				d[x * 2 + 1] = c.a;
+				break;
+			default:
+				assert(0);
+			}
+		}
+	}
+}
\ No newline at end of file
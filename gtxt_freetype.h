@@ -13,16 +13,69 @@ extern "C"
 
 struct gtxt_glyph_layout;
 struct gtxt_glyph_style;
+struct gtxt_glyph_output;
+
+struct gtxt_ft_context;
 
 void gtxt_ft_create();
 void gtxt_ft_release();
 
+// for rasterizing on other threads, bind a context per thread; contexts are
+// released before gtxt_ft_release()
+struct gtxt_ft_context* gtxt_ft_context_create();
+void gtxt_ft_context_release(struct gtxt_ft_context*);
+void gtxt_ft_context_bind(struct gtxt_ft_context*);
+
 int gtxt_ft_add_font(const char* name, const char* filepath);
+// the file is read again into the same id, keeping the old one if it fails;
+// contexts move to it on their next glyph of the font and glyphs cached from
+// the old one are dropped with gtxt_glyph_invalidate_font()
+bool gtxt_ft_reload_font(int font, const char* filepath);
+// bumped on each reload
+unsigned int gtxt_ft_get_font_generation(int font);
 
 int gtxt_ft_get_font_cout();
+// of the font file, to tell when cached glyphs are stale
+uint64_t gtxt_ft_get_font_checksum(int font);
+
+// colors written by gtxt_ft_gen_char() with the default context; other
+// contexts write straight colors unless set otherwise
+void gtxt_ft_set_premultiplied(bool premultiplied);
+void gtxt_ft_context_set_premultiplied(struct gtxt_ft_context*, bool premultiplied);
+bool gtxt_ft_is_premultiplied();
+
+// storage asked for once the glyph size is known, rows are written bottom-up
+// with the returned stride; NULL fails the glyph
+struct gtxt_ft_target {
+	void* (*alloc)(int w, int h, int bpp, int* stride, void* ud);
+	void* ud;
+};
 
 void gtxt_ft_get_layout(int unicode, float line_x, const struct gtxt_glyph_style*, struct gtxt_glyph_layout*);
+// into the context's buffer, valid until its next glyph
 uint32_t* gtxt_ft_gen_char(int unicode, float line_x, const struct gtxt_glyph_style*, struct gtxt_glyph_layout*);
+// glyphs without pixels, such as spaces, succeed without calling alloc
+bool gtxt_ft_gen_char_to(int unicode, float line_x, const struct gtxt_glyph_style*, struct gtxt_glyph_layout*, const struct gtxt_ft_target*);
+
+// 8-bit coverage, interleaved fill and edge when channels is 2
+uint8_t* gtxt_ft_gen_coverage(int unicode, const struct gtxt_glyph_style*, struct gtxt_glyph_layout*, int channels);
+bool gtxt_ft_gen_coverage_to(int unicode, const struct gtxt_glyph_style*, struct gtxt_glyph_layout*, int channels, const struct gtxt_ft_target*);
+// 8-bit distance field at ref_size, padded by spread pixels, 128 on the
+// outline and rising inwards; layout is of the padded field
+void gtxt_ft_get_sdf_layout(int unicode, int font, int ref_size, int spread, struct gtxt_glyph_layout*);
+uint8_t* gtxt_ft_gen_sdf(int unicode, int font, int ref_size, int spread, struct gtxt_glyph_layout*);
+bool gtxt_ft_gen_sdf_to(int unicode, int font, int ref_size, int spread, struct gtxt_glyph_layout*, const struct gtxt_ft_target*);
+// the field scaled by scale into fill coverage, and with 2 channels the edge
+// edge_size pixels around it, w and h include the edge
+void gtxt_ft_sdf_to_coverage(const uint8_t* sdf, int sdf_w, int sdf_h, int spread, float scale, float edge_size,
+                             uint8_t* dst, int w, int h, int channels);
+
+void gtxt_ft_colorize(const uint8_t* coverage, int channels, int w, int h, float line_x, const struct gtxt_glyph_style*,
+                      bool premultiplied, uint32_t* dst);
+
+void gtxt_ft_premultiply(uint32_t* pixels, int count);
+// from bottom-up RGBA
+void gtxt_ft_convert(const uint32_t* src, int w, int h, bool src_premultiplied, const struct gtxt_glyph_output*, void* dst);
 
 #endif // gametext_freetype_h
 
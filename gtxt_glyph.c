@@ -1,16 +1,59 @@
 #include "gtxt_glyph.h"
 #include "gtxt_freetype.h"
+#include "gtxt_atlas.h"
+#include "gtxt_hash.h"
+#include "gtxt_thread.h"
+#include "gtxt_disk.h"
+#include "gtxt_slab.h"
+#include "gtxt_span.h"
+#include "gtxt_util.h"
 
-#include <ds_hash.h>
 #include <ds_freelist.h>
 
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <math.h>
+#include <limits.h>
+#include <stdint.h>
+
+// per font and size counters, the last one takes the overflow
+#define STAT_SLOTS 32
+
+// reused entries passed over per eviction in GTXT_GLYPH_SLRU
+#define SECOND_CHANCE_MAX 32
+
+// entries over a lowered cap evicted per miss
+#define RESIZE_STEP 4
+// nodes added when a frame scope holds all of a shard's
+#define OVERFLOW_NODES 64
+
+// a handle is the node's index in its shard, the shard and the version
+#define HANDLE_VERSION_BITS 32
+#define HANDLE_VERSION_MAX UINT32_MAX
+
+// scaled styles go no further than this from their size
+#define SCALE_OCTAVES 4
+
+// per font generations, fonts sharing a slot are invalidated together
+#define FONT_GENS 64
+
+// styles are interned, see _style_intern()
+#define STYLE_CHUNK 256
+#define STYLE_CHUNKS 4096
+
+struct style_entry {
+	struct gtxt_glyph_style s;
+	uint64_t hash;
+	int id;
+	// glyphs, jobs and the threads' last lookups
+	int refs;
+	int next_free;
+};
 
 struct glyph_key {
 	int unicode;
-	struct gtxt_glyph_style s;
+	int style;
 	float line_x;
 };
 
@@ -19,38 +62,248 @@ struct glyph_bitmap {
 
 	bool valid;
 
-	uint32_t* buf;
+	void* buf;
+	// of the slab block
 	size_t sz;
+	int channels;
+	// buf points into the disk cache
+	bool mapped;
+	// buf holds span_sz bytes of gtxt_span_encode()
+	bool spans;
+	size_t span_sz;
+
+	struct gtxt_atlas_region region;
+	int w, h;
+	// the region pinned in the atlas while pinned or held
+	struct gtxt_atlas_region kept;
+	bool region_kept;
+
+	// of the glyph it is bound to, for the journal
+	int unicode, font, font_size;
+	// still bound if its bitmap and version are this
+	struct glyph* owner;
+
+	// frame of the last use, and whether it has been used in a later one
+	unsigned int frame;
+	bool reused;
+	// its glyph is pinned
+	bool pinned;
+	// the frame scope it was last used in
+	unsigned int scope;
+
+	int stat;
+	size_t bytes;
 
 	struct glyph_bitmap *prev, *next;
 };
 
 struct glyph {
+	uint64_t hash;
 	struct glyph_key key;
 
 	struct glyph_bitmap* bitmap;
 	int bmp_version;
 	struct gtxt_glyph_layout layout;
 
+	unsigned int frame;
+	bool reused;
+	int pins;
+	unsigned int scope;
+
+	// of handles, bumped on each reuse, never 0 once in use
+	int id;
+	unsigned int version;
+
+	// of its font when made, stale ones are no longer found
+	unsigned int font_gen;
+
+	int stat;
+
 	struct glyph *prev, *next;
 };
 
 DS_FREELIST(glyph_bitmap)
 DS_FREELIST(glyph)
 
-struct glyph_cache {
-	struct ds_hash* hash;
+// node storage, one per growth, kept until the shard is released
+struct node_chunk {
+	struct node_chunk* next;
+
+	struct glyph_bitmap* bitmaps;
+	int bitmap_count;
+	struct glyph* glyphs;
+	int glyph_count;
+	int first_glyph;
+};
+
+// style ids don't outlive the cache
+struct disk_key {
+	int unicode;
+	struct gtxt_glyph_style s;
+	float line_x;
+};
+
+// layout and pixels as saved in the disk cache
+struct disk_record {
+	struct disk_key key;
+	struct gtxt_glyph_layout layout;
+	int w, h;
+	// 0 for layout only
+	int channels;
+};
+
+#define DISK_FORMAT ((uint32_t)sizeof(struct disk_record) << 16 | (uint32_t)sizeof(struct disk_key))
+#define DISK_FLAG_COVERAGE 1
+#define DISK_FLAG_PREMULTIPLIED 2
+#define DISK_FLAG_SDF 4
+
+struct glyph_stats {
+	bool used;
+	struct gtxt_glyph_stats s;
+};
+
+// an evicted bitmap, its pixels follow
+struct cold_entry {
+	uint64_t hash;
+	struct glyph_key key;
+	struct gtxt_glyph_layout layout;
+	int stat;
+	unsigned int font_gen;
+
+	int w, h, channels;
+	// of gtxt_span_encode(), or raw if that is no smaller
+	bool spans;
+	size_t sz;
+
+	struct cold_entry *prev, *next;
+};
+
+struct glyph_shard {
+	gtxt_mutex lock;
+
+	struct gtxt_hash* hash;
 
 	struct ds_freelist_glyph_bitmap bmp_buf;
 	struct ds_freelist_glyph gly_buf;
+
+	struct node_chunk* chunks;
+	int cap_bitmap;
+	int cap_layout;
+	// in use, and allocated which may be more after a resize
+	int bmp_count, gly_count;
+	int bmp_alloc, gly_alloc;
+	// used in the current frame scope, not evicted until it ends
+	int bmp_held, gly_held;
+
+	// never evicted, up to half the caps
+	int gly_pinned, bmp_pinned;
+
+	// heap bytes held by bitmaps, kept under budget
+	size_t bmp_bytes;
+	struct gtxt_slab* slab;
+	size_t bmp_budget;
+
+	// scratch for encoding and decoding spans
+	uint8_t* span_buf;
+	size_t span_buf_sz;
+
+	// evicted bitmaps by key, oldest first, kept under cold_budget
+	struct gtxt_hash* cold_hash;
+	struct cold_entry *cold_head, *cold_tail;
+	size_t cold_bytes;
+	size_t cold_budget;
+	// atlas pixels read back or to be written
+	uint8_t* cold_buf;
+	size_t cold_buf_sz;
+
+	struct glyph_stats stats[STAT_SLOTS + 1];
+
+	// bitmap changes since the last drain, in order
+	struct gtxt_glyph_change* changes;
+	int change_count, change_cap;
+};
+
+struct glyph_cache {
+	// lock order: shard, ft, atlas
+	bool concurrent;
+	gtxt_mutex ft_lock;
+	gtxt_mutex atlas_lock;
+
+	struct gtxt_atlas* atlas;
+	int atlas_w, atlas_h, atlas_pages;
+	int atlas_bpp;
+
+	// cache coverage only, color is applied when emitting
+	bool coverage;
+	// heap coverage is kept span encoded
+	bool spans;
+	uint32_t* emit_buf;
+	size_t emit_sz;
+
+	uint8_t* cov_buf;
+	size_t cov_sz;
+
+	// distance fields of freetype glyphs, by font and unicode only
+	int sdf_size;
+	int sdf_spread;
+
+	// line_x in keys is rounded down to it, 0 for exact
+	float line_x_step;
+	// of gtxt_glyph_scale_style(), 0 for exact sizes
+	int scale_steps;
+
+	bool journal;
+
+	enum gtxt_glyph_policy policy;
+	// bumped by gtxt_glyph_begin_frame()
+	unsigned int frame;
+	// of the open frame scope, 0 if none
+	unsigned int scope;
+	unsigned int scope_count;
+
+	struct gtxt_disk* disk;
+
+	// bumped by gtxt_glyph_invalidate_font(), and as they were when the disk
+	// cache was loaded
+	unsigned int font_gens[FONT_GENS];
+	unsigned int disk_font_gens[FONT_GENS];
+
+	struct glyph_async* async;
+	// held by gtxt_glyph_enable_async() and across polls, before the shards
+	gtxt_mutex async_lock;
+
+	// synchronous rasters per frame, 0 for no limit, counted under ft_lock
+	int frame_max_rasters;
+	int frame_max_us;
+	int frame_rasters;
+	uint64_t frame_us;
+	int frame_deferred;
+
+	size_t bmp_budget;
+	size_t cold_budget;
+
+	// by chunk so entries don't move, guarded by style_lock, a leaf
+	gtxt_mutex style_lock;
+	struct gtxt_hash* style_hash;
+	struct style_entry* style_chunks[STYLE_CHUNKS];
+	int style_count;
+	int style_free;
+	// bumped when keys change, and for each cache
+	unsigned int style_epoch;
+	unsigned int generation;
+
+	int shard_count;
+	int shard_shift;
+	struct glyph_shard shards[1];
 };
 
 static struct glyph_cache* C;
+static unsigned int GENERATION;
 
 static uint32_t* (*CHAR_GEN)(const char* str, const struct gtxt_glyph_style* style, struct gtxt_glyph_layout* layout);
 static void      (*GET_UF_LAYOUT)(int unicode, int font, struct gtxt_glyph_layout* layout);
 
-static inline 
+static inline bool
 _is_color_same(const struct gtxt_glyph_color* c0, const struct gtxt_glyph_color* c1) {
     if (c0->mode_type != c1->mode_type) {
         return false;
@@ -90,244 +343,3683 @@ _is_color_same(const struct gtxt_glyph_color* c0, const struct gtxt_glyph_color*
     return true;
 }
 
-static inline uint32_t
-_hash_color(struct gtxt_glyph_color* col) {
-	uint32_t icol = 0;
+static inline uint64_t
+_hash_float(uint64_t h, float f) {
+	// 0.0f and -0.0f are equal
+	uint32_t bits = 0;
+	if (f != 0) {
+		memcpy(&bits, &f, sizeof(bits));
+	}
+	return gtxt_hash_mix(h, bits);
+}
+
+static inline uint64_t
+_hash_color(uint64_t h, const struct gtxt_glyph_color* col) {
+	h = gtxt_hash_mix(h, col->mode_type);
 	switch (col->mode_type)
 	{
 	case 0:
-		icol = col->mode.ONE.color.integer;
+		h = gtxt_hash_mix(h, col->mode.ONE.color.integer);
 		break;
 	case 1:
-		icol = col->mode.TWO.begin_col.integer ^ col->mode.TWO.end_col.integer;
+		h = gtxt_hash_mix(h, col->mode.TWO.begin_col.integer);
+		h = gtxt_hash_mix(h, col->mode.TWO.end_col.integer);
+		h = _hash_float(h, col->mode.TWO.begin_pos);
+		h = _hash_float(h, col->mode.TWO.end_pos);
+		h = _hash_float(h, col->mode.TWO.angle);
 		break;
 	case 2:
-		icol = col->mode.THREE.begin_col.integer ^ col->mode.THREE.mid_col.integer ^ col->mode.THREE.end_col.integer;
+		h = gtxt_hash_mix(h, col->mode.THREE.begin_col.integer);
+		h = gtxt_hash_mix(h, col->mode.THREE.mid_col.integer);
+		h = gtxt_hash_mix(h, col->mode.THREE.end_col.integer);
+		h = _hash_float(h, col->mode.THREE.begin_pos);
+		h = _hash_float(h, col->mode.THREE.mid_pos);
+		h = _hash_float(h, col->mode.THREE.end_pos);
+		h = _hash_float(h, col->mode.THREE.angle);
 		break;
 	default:
 		assert(0);
 	}
-	return icol;
+	return h;
+}
+
+static inline uint64_t
+_hash_style(const struct gtxt_glyph_style* style) {
+	uint64_t h = (uint64_t)(uint32_t)style->font;
+	h = gtxt_hash_mix(h, (uint32_t)style->font_size);
+	h = _hash_color(h, &style->font_color);
+	if (style->edge) {
+		h = _hash_float(h, style->edge_size);
+		h = _hash_color(h, &style->edge_color);
+	}
+	return h;
+}
+
+static inline bool
+_is_style_same(const struct gtxt_glyph_style* s0, const struct gtxt_glyph_style* s1) {
+	if (s0->font != s1->font
+	 || s0->font_size != s1->font_size
+	 || !_is_color_same(&s0->font_color, &s1->font_color)
+	 || s0->edge != s1->edge) {
+		return false;
+	}
+	return !s0->edge
+		|| (s0->edge_size == s1->edge_size && _is_color_same(&s0->edge_color, &s1->edge_color));
+}
+
+static inline struct style_entry*
+_style_get(int id) {
+	return &C->style_chunks[id / STYLE_CHUNK][id % STYLE_CHUNK];
+}
+
+static inline const struct gtxt_glyph_style*
+_key_style(const struct glyph_key* key) {
+	return &_style_get(key->style)->s;
+}
+
+static inline uint64_t
+_hash_key(const struct glyph_key* key) {
+	uint64_t h = (uint64_t)(uint32_t)key->unicode;
+	h = gtxt_hash_mix(h, _style_get(key->style)->hash);
+	h = _hash_float(h, key->line_x);
+	return gtxt_hash_finish(h);
+}
+
+static inline bool
+_is_key_same(const struct glyph_key* hk0, const struct glyph_key* hk1) {
+	return hk0->unicode == hk1->unicode
+		&& hk0->style == hk1->style
+		&& hk0->line_x == hk1->line_x;
 }
 
 static inline unsigned int
-_hash_func(int hash_sz, void* key) {
-	struct glyph_key* hk = (struct glyph_key*)key;
-	uint32_t hash;
-	if (hk->s.edge) {
-		struct gtxt_glyph_color* ecol = &hk->s.edge_color;
-		hash =
-			hk->unicode ^
-			(hk->s.font * 97) ^
-			(hk->s.font_size * 101) ^
-			_hash_color(&hk->s.font_color) ^
-			(int)(hk->s.edge_size * 10000) ^
-			_hash_color(&hk->s.edge_color) ^
-			((int)hk->line_x * 13);
-	} else {
-		hash =
-			hk->unicode ^
-			(hk->s.font * 97) ^
-			(hk->s.font_size * 101) ^
-			_hash_color(&hk->s.font_color) ^
-			((int)hk->line_x * 13);
+_font_gen(int font) {
+	return C->font_gens[(unsigned int)font % FONT_GENS];
+}
+
+// the font was invalidated since, left for eviction to reclaim
+static inline bool
+_is_glyph_stale(const struct glyph* g) {
+	return g->font_gen != _font_gen(_key_style(&g->key)->font);
+}
+
+static inline bool
+_is_disk_font_stale(int font) {
+	return C->disk_font_gens[(unsigned int)font % FONT_GENS] != _font_gen(font);
+}
+
+static inline bool
+_equal_func(const void* key, const void* val) {
+	const struct glyph* g = (const struct glyph*)val;
+	return _is_key_same((const struct glyph_key*)key, &g->key) && !_is_glyph_stale(g);
+}
+
+static inline bool
+_disk_equal_func(const void* key, const void* record) {
+	const struct glyph_key* k = (const struct glyph_key*)key;
+	const struct disk_key* dk = &((const struct disk_record*)record)->key;
+	return k->unicode == dk->unicode
+		&& k->line_x == dk->line_x
+		&& _is_style_same(_key_style(k), &dk->s);
+}
+
+static inline void
+_lock(gtxt_mutex* m) {
+	if (C->concurrent) {
+		gtxt_mutex_lock(m);
+	}
+}
+
+static inline void
+_unlock(gtxt_mutex* m) {
+	if (C->concurrent) {
+		gtxt_mutex_unlock(m);
 	}
-	return hash % hash_sz;
 }
 
 static inline bool
-_equal_func(void* key0, void* key1) {
-	struct glyph_key* hk0 = (struct glyph_key*)key0;
-	struct glyph_key* hk1 = (struct glyph_key*)key1;
-	if (hk0->unicode == hk1->unicode &&
-		hk0->s.font == hk1->s.font &&
-		hk0->s.font_size == hk1->s.font_size &&
-        _is_color_same(&hk0->s.font_color, &hk1->s.font_color) &&
-		hk0->s.edge == hk1->s.edge &&
-		hk0->line_x == hk1->line_x) {
-		if (hk0->s.edge) {
-            return hk0->s.edge_size	== hk1->s.edge_size
-			    && _is_color_same(&hk0->s.edge_color, &hk1->s.edge_color);
-		} else {
-            return true;
+_style_equal_func(const void* key, const void* val) {
+	return _is_style_same((const struct gtxt_glyph_style*)key, &((const struct style_entry*)val)->s);
+}
+
+// returns the id with a reference taken, -1 if out of memory
+static int
+_style_intern(const struct gtxt_glyph_style* style) {
+	uint64_t hash = _hash_style(style);
+	_lock(&C->style_lock);
+	struct style_entry* e = (struct style_entry*)gtxt_hash_query(C->style_hash, gtxt_hash_finish(hash), style, _style_equal_func);
+	if (!e) {
+		int id = C->style_free;
+		if (id >= 0) {
+			C->style_free = _style_get(id)->next_free;
+		} else if (C->style_count < STYLE_CHUNK * STYLE_CHUNKS) {
+			struct style_entry** chunk = &C->style_chunks[C->style_count / STYLE_CHUNK];
+			if (!*chunk) {
+				*chunk = (struct style_entry*)malloc(sizeof(struct style_entry) * STYLE_CHUNK);
+			}
+			if (*chunk) {
+				id = C->style_count++;
+			}
 		}
+		if (id < 0) {
+			_unlock(&C->style_lock);
+			return -1;
+		}
+		e = _style_get(id);
+		e->s = *style;
+		e->hash = hash;
+		e->id = id;
+		e->refs = 0;
+		if (!gtxt_hash_insert(C->style_hash, gtxt_hash_finish(hash), e)) {
+			e->next_free = C->style_free;
+			C->style_free = id;
+			_unlock(&C->style_lock);
+			return -1;
+		}
+	}
+	++e->refs;
+	int id = e->id;
+	_unlock(&C->style_lock);
+	return id;
+}
+
+static inline void
+_style_acquire(int id) {
+	_lock(&C->style_lock);
+	++_style_get(id)->refs;
+	_unlock(&C->style_lock);
+}
+
+static inline void
+_style_release(int id) {
+	_lock(&C->style_lock);
+	struct style_entry* e = _style_get(id);
+	assert(e->refs > 0);
+	if (--e->refs == 0) {
+		gtxt_hash_remove(C->style_hash, gtxt_hash_finish(e->hash), e);
+		e->next_free = C->style_free;
+		C->style_free = id;
+	}
+	_unlock(&C->style_lock);
+}
+
+static inline struct glyph_shard*
+_get_shard(uint64_t hash) {
+	// top bits, the table probes with the low ones
+	return C->shard_count == 1 ? &C->shards[0] : &C->shards[hash >> C->shard_shift];
+}
+
+static inline bool
+_cold_equal_func(const void* key, const void* val) {
+	const struct cold_entry* e = (const struct cold_entry*)val;
+	return _is_key_same((const struct glyph_key*)key, &e->key)
+		&& e->font_gen == _font_gen(_key_style(&e->key)->font);
+}
+
+// call with the shard locked
+static inline void
+_cold_unlink(struct glyph_shard* s, struct cold_entry* e) {
+	if (e->prev) {
+		e->prev->next = e->next;
 	} else {
-        return false;
+		s->cold_head = e->next;
 	}
+	if (e->next) {
+		e->next->prev = e->prev;
+	} else {
+		s->cold_tail = e->prev;
+	}
+	gtxt_hash_remove(s->cold_hash, e->hash, e);
+	assert(s->cold_bytes >= sizeof(*e) + e->sz);
+	s->cold_bytes -= sizeof(*e) + e->sz;
 }
 
-void
-gtxt_glyph_create(int cap_bitmap, int cap_layout,
-				  uint32_t* (*char_gen)(const char* str, const struct gtxt_glyph_style* style, struct gtxt_glyph_layout* layout),
-				  void (*get_uf_layout)(int unicode, int font, struct gtxt_glyph_layout* layout)) {
+static inline void
+_cold_free(struct cold_entry* e) {
+	_style_release(e->key.style);
+	free(e);
+}
+
+static void
+_cold_clear(struct glyph_shard* s) {
+	while (s->cold_head) {
+		struct cold_entry* e = s->cold_head;
+		_cold_unlink(s, e);
+		_cold_free(e);
+	}
+}
+
+static struct node_chunk*
+_chunk_create(int bitmap_count, int glyph_count, int first_glyph) {
+	size_t bitmap_sz = sizeof(struct glyph_bitmap) * bitmap_count;
+	size_t layout_sz = sizeof(struct glyph) * glyph_count;
+	size_t sz = sizeof(struct node_chunk) + bitmap_sz + layout_sz;
+	struct node_chunk* chunk = (struct node_chunk*)malloc(sz);
+	if (!chunk) {
+		return NULL;
+	}
+	memset(chunk, 0, sz);
+	chunk->bitmaps = (struct glyph_bitmap*)(chunk + 1);
+	chunk->bitmap_count = bitmap_count;
+	chunk->glyphs = (struct glyph*)((intptr_t)chunk->bitmaps + bitmap_sz);
+	chunk->glyph_count = glyph_count;
+	chunk->first_glyph = first_glyph;
+	for (int i = 0; i < glyph_count; ++i) {
+		chunk->glyphs[i].id = first_glyph + i;
+	}
+	return chunk;
+}
+
+static bool
+_shard_init(struct glyph_shard* s, int cap_bitmap, int cap_layout) {
+	struct node_chunk* chunk = _chunk_create(cap_bitmap, cap_layout, 0);
+	if (!chunk) {
+		return false;
+	}
+
+	s->hash = gtxt_hash_create(cap_layout);
+	s->slab = gtxt_slab_create();
+	if (!s->hash || !s->slab) {
+		gtxt_hash_release(s->hash); s->hash = NULL;
+		gtxt_slab_release(s->slab); s->slab = NULL;
+		free(chunk);
+		return false;
+	}
+
+	DS_FREELIST_CREATE(glyph_bitmap, s->bmp_buf, cap_bitmap, chunk->bitmaps);
+	DS_FREELIST_CREATE(glyph, s->gly_buf, cap_layout, chunk->glyphs);
+
+	s->chunks = chunk;
+	s->cap_bitmap = s->bmp_alloc = cap_bitmap;
+	s->cap_layout = s->gly_alloc = cap_layout;
+
+	s->stats[STAT_SLOTS].s.font = s->stats[STAT_SLOTS].s.font_size = -1;
+
+	gtxt_mutex_init(&s->lock);
+
+	return true;
+}
+
+// adds the nodes missing for the caps, call with the shard locked
+static bool
+_shard_grow(struct glyph_shard* s, int cap_bitmap, int cap_layout) {
+	int bitmap_count = MAX(cap_bitmap - s->bmp_alloc, 0);
+	int glyph_count = MAX(cap_layout - s->gly_alloc, 0);
+	if (bitmap_count == 0 && glyph_count == 0) {
+		return true;
+	}
+
+	struct node_chunk* chunk = _chunk_create(bitmap_count, glyph_count, s->gly_alloc);
+	if (!chunk) {
+		return false;
+	}
+	chunk->next = s->chunks;
+	s->chunks = chunk;
+
+	// in reverse, so they are taken in order
+	for (int i = bitmap_count - 1; i >= 0; --i) {
+		struct glyph_bitmap* bmp = &chunk->bitmaps[i];
+		bmp->next = s->bmp_buf.freelist;
+		s->bmp_buf.freelist = bmp;
+	}
+	for (int i = glyph_count - 1; i >= 0; --i) {
+		struct glyph* g = &chunk->glyphs[i];
+		g->next = s->gly_buf.freelist;
+		s->gly_buf.freelist = g;
+	}
+	s->bmp_alloc += bitmap_count;
+	s->gly_alloc += glyph_count;
+	return true;
+}
+
+static void
+_shard_release(struct glyph_shard* s) {
+	if (!s->chunks) {
+		return;
+	}
+	for (struct node_chunk* chunk = s->chunks; chunk; chunk = chunk->next) {
+		for (int i = 0; i < chunk->bitmap_count; ++i) {
+			struct glyph_bitmap* bmp = &chunk->bitmaps[i];
+			if (!bmp->mapped) {
+				gtxt_slab_free(s->slab, bmp->buf, bmp->sz);
+			}
+			bmp->buf = NULL;
+			bmp->sz = 0;
+		}
+	}
+	gtxt_slab_release(s->slab); s->slab = NULL;
+	free(s->span_buf); s->span_buf = NULL;
+	s->span_buf_sz = 0;
+	_cold_clear(s);
+	gtxt_hash_release(s->cold_hash); s->cold_hash = NULL;
+	free(s->cold_buf); s->cold_buf = NULL;
+	s->cold_buf_sz = 0;
+	free(s->changes); s->changes = NULL;
+	gtxt_hash_release(s->hash);
+	gtxt_mutex_release(&s->lock);
+	while (s->chunks) {
+		struct node_chunk* next = s->chunks->next;
+		free(s->chunks);
+		s->chunks = next;
+	}
+}
+
+static void
+_create(int cap_bitmap, int cap_layout, int shard_count, bool concurrent,
+		uint32_t* (*char_gen)(const char* str, const struct gtxt_glyph_style* style, struct gtxt_glyph_layout* layout),
+		void (*get_uf_layout)(int unicode, int font, struct gtxt_glyph_layout* layout)) {
 	CHAR_GEN = char_gen;
 	GET_UF_LAYOUT = get_uf_layout;
 
-	size_t bitmap_sz = sizeof(struct glyph_bitmap) * cap_bitmap;
-	size_t layout_sz = sizeof(struct glyph) * cap_layout;
-	size_t sz = sizeof(struct glyph_cache) + bitmap_sz + layout_sz;
+	int shard_bits = 0;
+	while ((1 << shard_bits) < shard_count) {
+		++shard_bits;
+	}
+	shard_count = 1 << shard_bits;
+
+	size_t sz = sizeof(struct glyph_cache) + sizeof(struct glyph_shard) * (shard_count - 1);
 	C = (struct glyph_cache*)malloc(sz);
 	if (!C) {
 		return;
 	}
 	memset(C, 0, sz);
 
-	C->hash = ds_hash_create(cap_layout, cap_layout * 2, 0.5f, _hash_func, _equal_func);
+	C->concurrent = concurrent;
+	C->shard_count = shard_count;
+	C->shard_shift = 64 - shard_bits;
+
+	gtxt_mutex_init(&C->style_lock);
+	C->style_free = -1;
+	C->generation = ++GENERATION;
+	C->style_hash = gtxt_hash_create(64);
+	if (!C->style_hash) {
+		gtxt_mutex_release(&C->style_lock);
+		free(C); C = NULL;
+		return;
+	}
 
-	DS_FREELIST_CREATE(glyph_bitmap, C->bmp_buf, cap_bitmap, C + 1);
-	DS_FREELIST_CREATE(glyph, C->gly_buf, cap_layout, (intptr_t)C->bmp_buf.freelist + bitmap_sz);
+	gtxt_mutex_init(&C->ft_lock);
+	gtxt_mutex_init(&C->atlas_lock);
+	gtxt_mutex_init(&C->async_lock);
+
+	int shard_bitmap = MAX(1, (cap_bitmap + shard_count - 1) / shard_count);
+	int shard_layout = MAX(1, (cap_layout + shard_count - 1) / shard_count);
+	for (int i = 0; i < shard_count; ++i) {
+		if (!_shard_init(&C->shards[i], shard_bitmap, shard_layout)) {
+			// a failed shard cleans up after itself, release the ones before
+			C->shard_count = i;
+			gtxt_glyph_release();
+			return;
+		}
+	}
 }
 
 void
-gtxt_glyph_release() {
-	struct glyph_bitmap* bmp = C->bmp_buf.freelist;
-	while (bmp) {
-		free(bmp->buf); bmp->buf = NULL;
-		bmp->sz = 0;
-		bmp = bmp->next;
-	}
-	bmp = C->bmp_buf.head;
-	while (bmp != C->bmp_buf.tail) {
-		free(bmp->buf); bmp->buf = NULL;
-		bmp->sz = 0;
-		bmp = bmp->next;
-	}
+gtxt_glyph_create(int cap_bitmap, int cap_layout,
+				  uint32_t* (*char_gen)(const char* str, const struct gtxt_glyph_style* style, struct gtxt_glyph_layout* layout),
+				  void (*get_uf_layout)(int unicode, int font, struct gtxt_glyph_layout* layout)) {
+	_create(cap_bitmap, cap_layout, 1, false, char_gen, get_uf_layout);
+}
 
-	free(C); C = NULL;
+void
+gtxt_glyph_create_concurrent(int cap_bitmap, int cap_layout, int shard_count,
+							 uint32_t* (*char_gen)(const char* str, const struct gtxt_glyph_style* style, struct gtxt_glyph_layout* layout),
+							 void (*get_uf_layout)(int unicode, int font, struct gtxt_glyph_layout* layout)) {
+	_create(cap_bitmap, cap_layout, MAX(1, shard_count), true, char_gen, get_uf_layout);
 }
 
-static inline struct glyph*
-_new_node() {
+void
+gtxt_glyph_release() {
 	if (!C) {
-		return NULL;
+		return;
 	}
 
-	if (!C->gly_buf.freelist) {
-		struct glyph* g = C->gly_buf.head;
-		assert(g);
-		DS_FREELIST_PUSH_NODE_TO_FREELIST(C->gly_buf, g);
-		ds_hash_remove(C->hash, &g->key);
-		if (g->bitmap) {
-// 			g->bitmap->valid = false;
-// 			g->bitmap->next = C->bmp_buf.freelist;
-// 			C->bmp_buf.freelist = g->bitmap;
-			g->bitmap = NULL;
-		}
+	gtxt_glyph_enable_async(0, NULL, NULL);
+
+	for (int i = 0; i < C->shard_count; ++i) {
+		_shard_release(&C->shards[i]);
 	}
 
-	struct glyph* g = NULL;
-	DS_FREELIST_POP_NODE_FROM_FREELIST(C->gly_buf, g);
-	if (g->bitmap) {
-		g->bitmap->valid = false;
-		g->bmp_version = 0;
+	gtxt_atlas_release(C->atlas);
+	free(C->emit_buf);
+	free(C->cov_buf);
+	gtxt_disk_close(C->disk);
+
+	gtxt_mutex_release(&C->ft_lock);
+	gtxt_mutex_release(&C->atlas_lock);
+	gtxt_mutex_release(&C->async_lock);
+
+	for (int i = 0; i < STYLE_CHUNKS; ++i) {
+		free(C->style_chunks[i]);
 	}
+	gtxt_hash_release(C->style_hash);
+	gtxt_mutex_release(&C->style_lock);
 
-	return g;
+	free(C); C = NULL;
 }
 
-struct gtxt_glyph_layout*
-gtxt_glyph_get_layout(int unicode, float line_x, const struct gtxt_glyph_style* style) {
-	if (!C) {
-		return NULL;
+static int
+_stat_find(struct glyph_shard* s, int font, int font_size) {
+	unsigned int h = (unsigned int)font * 31 + (unsigned int)font_size;
+	for (int i = 0; i < STAT_SLOTS; ++i) {
+		struct glyph_stats* st = &s->stats[(h + i) % STAT_SLOTS];
+		if (!st->used) {
+			st->used = true;
+			st->s.font = font;
+			st->s.font_size = font_size;
+			return (h + i) % STAT_SLOTS;
+		}
+		if (st->s.font == font && st->s.font_size == font_size) {
+			return (h + i) % STAT_SLOTS;
+		}
 	}
+	s->stats[STAT_SLOTS].used = true;
+	return STAT_SLOTS;
+}
 
-	struct glyph_key key;
-	key.unicode = unicode;
-	key.s = *style;
-    key.line_x = line_x;
+static inline struct gtxt_glyph_stats*
+_stat(struct glyph_shard* s, int idx) {
+	return &s->stats[idx].s;
+}
 
-	struct glyph* g = (struct glyph*)ds_hash_query(C->hash, &key);
-	if (g) {
-		return &g->layout;
-	} else {
-		g = _new_node();
+static inline void
+_bitmap_set_bytes(struct glyph_shard* s, struct glyph_bitmap* bmp, size_t bytes) {
+	struct gtxt_glyph_stats* st = _stat(s, bmp->stat);
+	st->bitmap.bytes = st->bitmap.bytes - bmp->bytes + bytes;
+	if (bmp->pinned) {
+		st->bitmap.pinned_bytes = st->bitmap.pinned_bytes - bmp->bytes + bytes;
+	}
+	bmp->bytes = bytes;
+}
+
+// call with the shard locked
+static void
+_journal_add(struct glyph_shard* s, const struct glyph_bitmap* bmp, enum gtxt_glyph_change_type type) {
+	if (!C->journal) {
+		return;
+	}
 
-		int ft_count = gtxt_ft_get_font_cout();
-		if (style->font < ft_count) {
-			gtxt_ft_get_layout(unicode, line_x, style, &g->layout);
+	if (s->change_count == s->change_cap) {
+		// past twice the bitmaps the renderer is better off re-checking all
+		int cap = s->change_cap == 0 ? 64 : s->change_cap * 2;
+		struct gtxt_glyph_change* changes = NULL;
+		if (s->change_cap < s->cap_bitmap * 2) {
+			changes = (struct gtxt_glyph_change*)realloc(s->changes, sizeof(*changes) * cap);
+		}
+		if (changes) {
+			s->changes = changes;
+			s->change_cap = cap;
+		} else if (s->change_cap > 0) {
+			s->change_count = 0;
+			type = GTXT_GLYPH_RESET;
 		} else {
-			GET_UF_LAYOUT(unicode, ft_count - style->font, &g->layout);
+			return;
 		}
+	}
 
-		g->key = key;
-		ds_hash_insert(C->hash, &g->key, g, true);
+	struct gtxt_glyph_change* c = &s->changes[s->change_count++];
+	memset(c, 0, sizeof(*c));
+	c->type = type;
+	if (type == GTXT_GLYPH_RESET) {
+		c->page = -1;
+		return;
+	}
 
-		return &g->layout;
+	c->unicode = bmp->unicode;
+	c->font = bmp->font;
+	c->font_size = bmp->font_size;
+	if (type == GTXT_GLYPH_CREATED && !C->atlas && !bmp->spans) {
+		c->pixels = bmp->buf;
 	}
+	c->page = C->atlas ? bmp->region.page : -1;
+	c->x = bmp->region.x;
+	c->y = bmp->region.y;
+	c->w = bmp->w;
+	c->h = bmp->h;
+	c->channels = bmp->channels;
+	c->version = bmp->version;
 }
 
-uint32_t*
-gtxt_glyph_get_bitmap(int unicode, float line_x, const struct gtxt_glyph_style* style, struct gtxt_glyph_layout* layout) {
-	if (!C) {
-		return NULL;
+static inline void
+_journal_reset() {
+	for (int i = 0; i < C->shard_count; ++i) {
+		struct glyph_shard* s = &C->shards[i];
+		s->change_count = 0;
+		_journal_add(s, NULL, GTXT_GLYPH_RESET);
 	}
+}
 
-	struct glyph_key key;
-	key.unicode = unicode;
-	key.s = *style;
-	key.line_x = line_x;
+static inline bool
+_is_bitmap_held(const struct glyph_bitmap* bmp) {
+	return C->scope != 0 && bmp->scope == C->scope;
+}
 
-	struct glyph* g = (struct glyph*)ds_hash_query(C->hash, &key);
-	if (g) {
-		DS_FREELIST_MOVE_NODE_TO_TAIL(C->gly_buf, g);
-		*layout = g->layout;
+// the atlas page of a pinned or held bitmap isn't recycled, call when
+// either or the region changes
+static inline void
+_bitmap_keep_region(struct glyph_bitmap* bmp) {
+	bool keep = C->atlas && bmp->valid && bmp->region.page != -1
+			 && (bmp->pinned || _is_bitmap_held(bmp));
+	if (keep == bmp->region_kept && (!keep || (bmp->kept.page == bmp->region.page
+											&& bmp->kept.version == bmp->region.version))) {
+		return;
+	}
+	_lock(&C->atlas_lock);
+	if (bmp->region_kept) {
+		gtxt_atlas_pin(C->atlas, &bmp->kept, false);
+	}
+	if (keep) {
+		gtxt_atlas_pin(C->atlas, &bmp->region, true);
+	}
+	_unlock(&C->atlas_lock);
+	bmp->kept = bmp->region;
+	bmp->region_kept = keep;
+}
+
+static inline void
+_bitmap_set_pinned(struct glyph_shard* s, struct glyph_bitmap* bmp, bool pinned) {
+	if (bmp->pinned == pinned) {
+		return;
+	}
+	struct gtxt_glyph_stats* st = _stat(s, bmp->stat);
+	if (pinned) {
+		bmp->pinned = true;
+		++s->bmp_pinned;
+		++st->bitmap.pinned;
+		st->bitmap.pinned_bytes += bmp->bytes;
 	} else {
-		g = _new_node();
-		g->key = key;
-		ds_hash_insert(C->hash, &g->key, g, true);
+		st->bitmap.pinned_bytes -= bmp->bytes;
+		--st->bitmap.pinned;
+		--s->bmp_pinned;
+		bmp->pinned = false;
 	}
+	_bitmap_keep_region(bmp);
+}
 
-	if (g->bitmap && g->bitmap->version != g->bmp_version) {
-		++g->bitmap->version;
-		DS_FREELIST_PUSH_NODE_TO_FREELIST(C->bmp_buf, g->bitmap);
-		g->bitmap = NULL;
-		g->bmp_version = 0;
+// the last pin went
+static inline void
+_glyph_unpinned(struct glyph_shard* s, struct glyph* g) {
+	--s->gly_pinned;
+	struct gtxt_glyph_stats* st = _stat(s, g->stat);
+	--st->layout.pinned;
+	st->layout.pinned_bytes -= sizeof(struct glyph);
+
+	if (g->bitmap && g->bitmap->version == g->bmp_version) {
+		_bitmap_set_pinned(s, g->bitmap, false);
 	}
+}
 
-	if (!g->bitmap) {
-		// move first to freelist
-		if (!C->bmp_buf.freelist) {
-			assert(C->bmp_buf.head);
-			++C->bmp_buf.head->version;
-			// shouldn't pass head directly!!
-			// DECONNECT_NODE may change the params
-			struct glyph_bitmap* bmp = C->bmp_buf.head;
-			DS_FREELIST_PUSH_NODE_TO_FREELIST(C->bmp_buf, bmp);
-		}
+static inline void
+_glyph_unpin_all(struct glyph_shard* s, struct glyph* g) {
+	g->pins = 0;
+	_glyph_unpinned(s, g);
+}
 
-		g->bitmap = C->bmp_buf.freelist;
-		g->bmp_version = g->bitmap->version;
+// call once the pixels are in place
+static inline void
+_bitmap_validate(struct glyph_shard* s, struct glyph_bitmap* bmp, int w, int h, int bpp) {
+	_bitmap_set_bytes(s, bmp, bmp->spans ? bmp->span_sz : (size_t)w * h * bpp);
+	bmp->w = w;
+	bmp->h = h;
+	bmp->valid = true;
+	_bitmap_keep_region(bmp);
+	_journal_add(s, bmp, GTXT_GLYPH_CREATED);
+}
 
-		C->bmp_buf.freelist = C->bmp_buf.freelist->next;
-		g->bitmap->valid = false;
+static inline void
+_bitmap_clear(struct glyph_shard* s, struct glyph_bitmap* bmp) {
+	_bitmap_set_bytes(s, bmp, 0);
+	bmp->valid = false;
+	_bitmap_keep_region(bmp);
+	if (C->atlas) {
+		_lock(&C->atlas_lock);
+		gtxt_atlas_free(C->atlas, &bmp->region);
+		_unlock(&C->atlas_lock);
+		bmp->region.page = -1;
 	}
+}
 
-	if (g->bitmap->valid) {
-		return g->bitmap->buf;
+static inline void
+_bitmap_free_buf(struct glyph_shard* s, struct glyph_bitmap* bmp) {
+	assert(s->bmp_bytes >= bmp->sz);
+	s->bmp_bytes -= bmp->sz;
+	if (!bmp->mapped) {
+		gtxt_slab_free(s->slab, bmp->buf, bmp->sz);
 	}
+	bmp->buf = NULL;
+	bmp->sz = 0;
+	bmp->mapped = false;
+	bmp->spans = false;
+}
 
-	uint32_t* ret_buf = NULL;
-	uint32_t* buf = gtxt_ft_gen_char(unicode, line_x, style, &g->layout);
-	if (!buf && CHAR_GEN) {
-		buf = CHAR_GEN("", style, &g->layout);
+static inline bool
+_is_glyph_held(const struct glyph* g) {
+	return C->scope != 0 && g->scope == C->scope;
+}
+
+// kept until the frame scope ends
+static inline void
+_hold_glyph(struct glyph_shard* s, struct glyph* g) {
+	if (C->scope != 0 && g->scope != C->scope) {
+		g->scope = C->scope;
+		++s->gly_held;
 	}
-	if (!buf) {
-		ret_buf = NULL;
+}
+
+static inline void
+_hold_bitmap(struct glyph_shard* s, struct glyph_bitmap* bmp) {
+	if (C->scope != 0 && bmp->scope != C->scope) {
+		bmp->scope = C->scope;
+		++s->bmp_held;
+		_bitmap_keep_region(bmp);
+	}
+}
+
+// a use in a later frame than the last one marks the entry as reused, so
+// a scan of one-off glyphs is evicted before it
+static inline void
+_touch_glyph(struct glyph_shard* s, struct glyph* g) {
+	if (g->frame != C->frame) {
+		g->frame = C->frame;
+		g->reused = true;
+	}
+	_hold_glyph(s, g);
+	DS_FREELIST_MOVE_NODE_TO_TAIL(s->gly_buf, g);
+}
+
+static inline void
+_touch_bitmap(struct glyph_shard* s, struct glyph_bitmap* bmp) {
+	if (bmp->frame != C->frame) {
+		bmp->frame = C->frame;
+		bmp->reused = true;
+	}
+	_hold_bitmap(s, bmp);
+	DS_FREELIST_MOVE_NODE_TO_TAIL(s->bmp_buf, bmp);
+}
+
+// the least recently used, pinned or held ones at the head go back to the
+// tail, and in GTXT_GLYPH_SLRU reused ones too, losing the mark; NULL if
+// only pinned or held ones are left
+static inline struct glyph*
+_glyph_victim(struct glyph_shard* s) {
+	struct glyph* g = s->gly_buf.head;
+	int kept = s->gly_pinned + s->gly_held;
+	int chances = C->policy == GTXT_GLYPH_SLRU ? SECOND_CHANCE_MAX : 0;
+	while (g && g != s->gly_buf.tail) {
+		// can't be unpinned once its font is invalidated
+		if (g->pins > 0 && _is_glyph_stale(g)) {
+			_glyph_unpin_all(s, g);
+		}
+		bool keep = g->pins > 0 || _is_glyph_held(g);
+		if (keep && kept > 0) {
+			--kept;
+		} else if (!keep && g->reused && chances > 0) {
+			--chances;
+			g->reused = false;
+		} else {
+			break;
+		}
+		DS_FREELIST_MOVE_NODE_TO_TAIL(s->gly_buf, g);
+		g = s->gly_buf.head;
+	}
+	return g && g->pins == 0 && !_is_glyph_held(g) ? g : NULL;
+}
+
+static inline struct glyph_bitmap*
+_bitmap_victim(struct glyph_shard* s) {
+	struct glyph_bitmap* bmp = s->bmp_buf.head;
+	int kept = s->bmp_pinned + s->bmp_held;
+	int chances = C->policy == GTXT_GLYPH_SLRU ? SECOND_CHANCE_MAX : 0;
+	while (bmp && bmp != s->bmp_buf.tail) {
+		bool keep = bmp->pinned || _is_bitmap_held(bmp);
+		if (keep && kept > 0) {
+			--kept;
+		} else if (!keep && bmp->reused && chances > 0) {
+			--chances;
+			bmp->reused = false;
+		} else {
+			break;
+		}
+		DS_FREELIST_MOVE_NODE_TO_TAIL(s->bmp_buf, bmp);
+		bmp = s->bmp_buf.head;
+	}
+	return bmp && !bmp->pinned && !_is_bitmap_held(bmp) ? bmp : NULL;
+}
+
+// call with the shard locked
+static inline uint8_t*
+_prepare_cold_buf(struct glyph_shard* s, size_t sz) {
+	if (s->cold_buf_sz < sz) {
+		free(s->cold_buf);
+		s->cold_buf = (uint8_t*)malloc(sz);
+		s->cold_buf_sz = s->cold_buf ? sz : 0;
+	}
+	return s->cold_buf;
+}
+
+// keeps a copy of a valid bitmap about to be evicted in the cold tier,
+// making room by dropping its oldest entries
+static void
+_cold_put(struct glyph_shard* s, struct glyph_bitmap* bmp) {
+	struct glyph* g = bmp->owner;
+	// the mapped ones are as cheap to load again
+	if (s->cold_budget == 0 || bmp->mapped || !g || g->bitmap != bmp || g->bmp_version != bmp->version || _is_glyph_stale(g)) {
+		return;
+	}
+	size_t raw = (size_t)bmp->w * bmp->h * bmp->channels;
+	if (raw == 0) {
+		return;
+	}
+
+	const uint8_t* pixels = (const uint8_t*)bmp->buf;
+	if (C->atlas) {
+		uint8_t* buf = _prepare_cold_buf(s, raw);
+		_lock(&C->atlas_lock);
+		bool read = buf && gtxt_atlas_read(C->atlas, &bmp->region, buf);
+		_unlock(&C->atlas_lock);
+		if (!read) {
+			return;
+		}
+		pixels = buf;
+	}
+
+	// encoded in place, up to the raw size
+	bool spans = bmp->spans;
+	size_t sz = spans ? bmp->span_sz : raw;
+	struct cold_entry* e = (struct cold_entry*)malloc(sizeof(*e) + sz);
+	if (!e) {
+		return;
+	}
+	if (spans) {
+		memcpy(e + 1, pixels, sz);
+	} else {
+		size_t enc = gtxt_span_encode(pixels, bmp->w, bmp->h, bmp->channels, (uint8_t*)(e + 1), raw);
+		if (enc < raw) {
+			spans = true;
+			sz = enc;
+			struct cold_entry* shrunk = (struct cold_entry*)realloc(e, sizeof(*e) + sz);
+			if (shrunk) {
+				e = shrunk;
+			}
+		} else {
+			memcpy(e + 1, pixels, raw);
+		}
+	}
+	if (sizeof(*e) + sz > s->cold_budget) {
+		free(e);
+		return;
+	}
+
+	e->hash = g->hash;
+	e->key = g->key;
+	_style_acquire(e->key.style);
+	e->layout = g->layout;
+	e->stat = g->stat;
+	e->font_gen = g->font_gen;
+	e->w = bmp->w;
+	e->h = bmp->h;
+	e->channels = bmp->channels;
+	e->spans = spans;
+	e->sz = sz;
+
+	// drawn again meanwhile, such as by prewarm
+	struct cold_entry* old = (struct cold_entry*)gtxt_hash_query(s->cold_hash, e->hash, &e->key, _cold_equal_func);
+	if (old) {
+		_cold_unlink(s, old);
+		_cold_free(old);
+	}
+	while (s->cold_head && s->cold_bytes + sizeof(*e) + sz > s->cold_budget) {
+		old = s->cold_head;
+		_cold_unlink(s, old);
+		_cold_free(old);
+	}
+	if (!gtxt_hash_insert(s->cold_hash, e->hash, e)) {
+		_cold_free(e);
+		return;
+	}
+
+	e->prev = s->cold_tail;
+	e->next = NULL;
+	if (s->cold_tail) {
+		s->cold_tail->next = e;
+	} else {
+		s->cold_head = e;
+	}
+	s->cold_tail = e;
+	s->cold_bytes += sizeof(*e) + sz;
+}
+
+// give the bitmap back to the freelist, its glyph sees the version change
+static inline void
+_bitmap_release(struct glyph_shard* s, struct glyph_bitmap* bmp) {
+	if (bmp->valid) {
+		++_stat(s, bmp->stat)->bitmap.evictions;
+		_journal_add(s, bmp, GTXT_GLYPH_EVICTED);
+		_cold_put(s, bmp);
+	}
+	++bmp->version;
+	_bitmap_clear(s, bmp);
+	_bitmap_set_pinned(s, bmp, false);
+	_bitmap_free_buf(s, bmp);
+	if (_is_bitmap_held(bmp)) {
+		--s->bmp_held;
+	}
+	bmp->scope = 0;
+	DS_FREELIST_PUSH_NODE_TO_FREELIST(s->bmp_buf, bmp);
+	--s->bmp_count;
+}
+
+// the budget is of the slabs, with their free blocks, so evicts until one
+// of sz bytes more fits, handing emptied slabs back; false if only pinned,
+// held or the keep bitmap are left
+static bool
+_bitmap_fit(struct glyph_shard* s, size_t sz, const struct glyph_bitmap* keep) {
+	while (gtxt_slab_get_bytes(s->slab) + gtxt_slab_alloc_bytes(s->slab, sz) > s->bmp_budget) {
+		if (gtxt_slab_trim(s->slab) > 0) {
+			continue;
+		}
+		struct glyph_bitmap* old = _bitmap_victim(s);
+		if (!old || old == keep) {
+			return false;
+		}
+		_bitmap_release(s, old);
+	}
+	return true;
+}
+
+// in the lock order, so nothing is halfway while settings change
+static inline void
+_lock_all() {
+	for (int i = 0; i < C->shard_count; ++i) {
+		_lock(&C->shards[i].lock);
+	}
+	_lock(&C->ft_lock);
+	_lock(&C->atlas_lock);
+}
+
+static inline void
+_unlock_all() {
+	_unlock(&C->atlas_lock);
+	_unlock(&C->ft_lock);
+	for (int i = C->shard_count - 1; i >= 0; --i) {
+		_unlock(&C->shards[i].lock);
+	}
+}
+
+static inline void
+_invalid_bitmaps() {
+	for (int i = 0; i < C->shard_count; ++i) {
+		struct glyph_shard* s = &C->shards[i];
+		for (struct node_chunk* chunk = s->chunks; chunk; chunk = chunk->next) {
+			for (int j = 0; j < chunk->bitmap_count; ++j) {
+				struct glyph_bitmap* bmp = &chunk->bitmaps[j];
+				++bmp->version;
+				bmp->valid = false;
+				bmp->region.page = -1;
+				// pins went with the atlas
+				bmp->region_kept = false;
+				_bitmap_set_bytes(s, bmp, 0);
+				// pinned glyphs pin their next bitmap
+				_bitmap_set_pinned(s, bmp, false);
+				_bitmap_free_buf(s, bmp);
+			}
+		}
+		_cold_clear(s);
+	}
+	_journal_reset();
+}
+
+static inline void
+_reset_atlas() {
+	gtxt_atlas_release(C->atlas);
+	C->atlas = NULL;
+	if (C->atlas_pages > 0) {
+		if (C->sdf_size > 0) {
+			C->atlas_bpp = 1;
+		} else {
+			C->atlas_bpp = C->coverage ? 2 : sizeof(uint32_t);
+		}
+		C->atlas = gtxt_atlas_create(C->atlas_w, C->atlas_h, C->atlas_pages, C->atlas_bpp);
+	}
+	_invalid_bitmaps();
+}
+
+// keys change
+static inline void
+_drop_glyphs() {
+	++C->style_epoch;
+	for (int i = 0; i < C->shard_count; ++i) {
+		struct glyph_shard* s = &C->shards[i];
+		while (s->gly_buf.head) {
+			struct glyph* g = s->gly_buf.head;
+			gtxt_hash_remove(s->hash, g->hash, g);
+			struct gtxt_glyph_stats* st = _stat(s, g->stat);
+			st->layout.bytes -= sizeof(struct glyph);
+			if (g->pins > 0) {
+				--st->layout.pinned;
+				st->layout.pinned_bytes -= sizeof(struct glyph);
+				g->pins = 0;
+			}
+			_style_release(g->key.style);
+			g->bitmap = NULL;
+			g->bmp_version = 0;
+			g->version = g->version % HANDLE_VERSION_MAX + 1;
+			g->scope = 0;
+			DS_FREELIST_PUSH_NODE_TO_FREELIST(s->gly_buf, g);
+			--s->gly_count;
+		}
+		s->gly_held = 0;
+	}
+}
+
+void
+gtxt_glyph_enable_atlas(int page_width, int page_height, int max_pages) {
+	if (!C) {
+		return;
+	}
+
+	_lock_all();
+	C->atlas_w = page_width;
+	C->atlas_h = page_height;
+	C->atlas_pages = max_pages;
+	_reset_atlas();
+	_unlock_all();
+}
+
+void
+gtxt_glyph_enable_coverage(bool enable) {
+	if (!C || C->coverage == enable) {
+		return;
+	}
+
+	_lock_all();
+	C->coverage = enable;
+	_drop_glyphs();
+	_reset_atlas();
+	_unlock_all();
+}
+
+bool
+gtxt_glyph_enable_spans(bool enable) {
+	if (!C) {
+		return false;
+	}
+
+	// each bitmap knows its form, the cached ones stay as they are
+	_lock_all();
+	bool succ = !enable || (C->coverage && !C->atlas);
+	if (succ) {
+		C->spans = enable;
+	}
+	_unlock_all();
+
+	return succ;
+}
+
+void
+gtxt_glyph_enable_sdf(int ref_size, int spread) {
+	if (!C) {
+		return;
+	}
+
+	if (ref_size > 0) {
+		// what the freetype sdf renderer takes
+		spread = MIN(32, MAX(spread, 2));
+	} else {
+		ref_size = spread = 0;
+	}
+	if (C->sdf_size == ref_size && C->sdf_spread == spread) {
+		return;
+	}
+
+	_lock_all();
+	C->sdf_size = ref_size;
+	C->sdf_spread = spread;
+	_drop_glyphs();
+	_reset_atlas();
+	_unlock_all();
+}
+
+bool
+gtxt_glyph_set_format(enum gtxt_glyph_format format) {
+	if (!C) {
+		return false;
+	}
+
+	switch (format)
+	{
+	case GTXT_GLYPH_A8:
+		gtxt_glyph_enable_coverage(true);
+		return true;
+	case GTXT_GLYPH_RGBA: case GTXT_GLYPH_RGBA_PREMUL:
+		gtxt_glyph_enable_coverage(false);
+		break;
+	default:
+		return false;
+	}
+
+	bool premultiplied = format == GTXT_GLYPH_RGBA_PREMUL;
+	if (gtxt_ft_is_premultiplied() == premultiplied) {
+		return true;
+	}
+
+	_lock_all();
+	gtxt_ft_set_premultiplied(premultiplied);
+	// pixels change, keys don't
+	_reset_atlas();
+	_unlock_all();
+
+	return true;
+}
+
+enum gtxt_glyph_format
+gtxt_glyph_get_format() {
+	if (C && C->coverage) {
+		return GTXT_GLYPH_A8;
+	}
+	return gtxt_ft_is_premultiplied() ? GTXT_GLYPH_RGBA_PREMUL : GTXT_GLYPH_RGBA;
+}
+
+void
+gtxt_glyph_set_line_x_step(float step) {
+	if (C) {
+		C->line_x_step = MAX(step, 0);
+	}
+}
+
+void
+gtxt_glyph_set_scale_steps(int steps_per_octave) {
+	if (C) {
+		C->scale_steps = MAX(steps_per_octave, 0);
+	}
+}
+
+void
+gtxt_glyph_set_policy(enum gtxt_glyph_policy policy) {
+	if (!C) {
+		return;
+	}
+
+	_lock_all();
+	C->policy = policy;
+	_unlock_all();
+}
+
+void
+gtxt_glyph_enable_journal(bool enable) {
+	if (!C || C->journal == enable) {
+		return;
+	}
+
+	_lock_all();
+	C->journal = enable;
+	for (int i = 0; i < C->shard_count; ++i) {
+		struct glyph_shard* s = &C->shards[i];
+		free(s->changes);
+		s->changes = NULL;
+		s->change_count = s->change_cap = 0;
+	}
+	_unlock_all();
+}
+
+int
+gtxt_glyph_drain_changes(struct gtxt_glyph_change* changes, int cap) {
+	if (!C || !C->journal) {
+		return 0;
+	}
+
+	int count = 0;
+	for (int i = 0; i < C->shard_count && count < cap; ++i) {
+		struct glyph_shard* s = &C->shards[i];
+		_lock(&s->lock);
+		int n = MIN(s->change_count, cap - count);
+		memcpy(&changes[count], s->changes, sizeof(*changes) * n);
+		// the rest are kept for the next call
+		memmove(s->changes, s->changes + n, sizeof(*changes) * (s->change_count - n));
+		s->change_count -= n;
+		_unlock(&s->lock);
+		count += n;
+	}
+	return count;
+}
+
+size_t
+gtxt_glyph_trim() {
+	if (!C) {
+		return 0;
+	}
+
+	size_t reclaimed = 0;
+	for (int i = 0; i < C->shard_count; ++i) {
+		struct glyph_shard* s = &C->shards[i];
+		_lock(&s->lock);
+		reclaimed += gtxt_slab_trim(s->slab);
+		_unlock(&s->lock);
+	}
+	return reclaimed;
+}
+
+bool
+gtxt_glyph_resize(int cap_bitmap, int cap_layout) {
+	if (!C) {
+		return false;
+	}
+
+	int shard_bitmap = MAX(1, (cap_bitmap + C->shard_count - 1) / C->shard_count);
+	int shard_layout = MAX(1, (cap_layout + C->shard_count - 1) / C->shard_count);
+	bool succ = true;
+	for (int i = 0; i < C->shard_count; ++i) {
+		struct glyph_shard* s = &C->shards[i];
+		_lock(&s->lock);
+		if (_shard_grow(s, shard_bitmap, shard_layout)) {
+			s->cap_bitmap = shard_bitmap;
+			s->cap_layout = shard_layout;
+			gtxt_hash_reserve(s->hash, shard_layout);
+		} else {
+			succ = false;
+		}
+		_unlock(&s->lock);
+	}
+	return succ;
+}
+
+void
+gtxt_glyph_invalidate_font(int font) {
+	if (!C) {
+		return;
+	}
+
+	// no lookup is halfway
+	_lock_all();
+	++C->font_gens[(unsigned int)font % FONT_GENS];
+	_unlock_all();
+}
+
+void
+gtxt_glyph_set_cold_budget(size_t bytes) {
+	if (!C) {
+		return;
+	}
+
+	C->cold_budget = bytes;
+	for (int i = 0; i < C->shard_count; ++i) {
+		struct glyph_shard* s = &C->shards[i];
+		_lock(&s->lock);
+		s->cold_budget = bytes / C->shard_count;
+		if (s->cold_budget > 0 && !s->cold_hash) {
+			s->cold_hash = gtxt_hash_create(64);
+			if (!s->cold_hash) {
+				s->cold_budget = 0;
+			}
+		}
+		while (s->cold_head && s->cold_bytes > s->cold_budget) {
+			struct cold_entry* e = s->cold_head;
+			_cold_unlink(s, e);
+			_cold_free(e);
+		}
+		_unlock(&s->lock);
+	}
+}
+
+size_t
+gtxt_glyph_get_cold_bytes() {
+	if (!C) {
+		return 0;
+	}
+
+	size_t bytes = 0;
+	for (int i = 0; i < C->shard_count; ++i) {
+		struct glyph_shard* s = &C->shards[i];
+		_lock(&s->lock);
+		bytes += s->cold_bytes;
+		_unlock(&s->lock);
+	}
+	return bytes;
+}
+
+void
+gtxt_glyph_set_frame_budget(int max_rasters, int max_us) {
+	if (!C) {
+		return;
+	}
+
+	_lock(&C->ft_lock);
+	C->frame_max_rasters = MAX(max_rasters, 0);
+	C->frame_max_us = MAX(max_us, 0);
+	_unlock(&C->ft_lock);
+}
+
+int
+gtxt_glyph_begin_frame() {
+	if (!C) {
+		return 0;
+	}
+
+	// the shards read the frame under their own locks
+	_lock_all();
+	int deferred = C->frame_deferred;
+	++C->frame;
+	C->frame_rasters = 0;
+	C->frame_us = 0;
+	C->frame_deferred = 0;
+	_unlock_all();
+
+	return deferred;
+}
+
+// call with all locked as the scope changes, regions of the bitmaps only
+// held are let go
+static inline void
+_drop_held_regions() {
+	if (!C->atlas) {
+		return;
+	}
+	for (int i = 0; i < C->shard_count; ++i) {
+		for (struct node_chunk* chunk = C->shards[i].chunks; chunk; chunk = chunk->next) {
+			for (int j = 0; j < chunk->bitmap_count; ++j) {
+				struct glyph_bitmap* bmp = &chunk->bitmaps[j];
+				if (bmp->region_kept && !bmp->pinned) {
+					gtxt_atlas_pin(C->atlas, &bmp->kept, false);
+					bmp->region_kept = false;
+				}
+			}
+		}
+	}
+}
+
+int
+gtxt_glyph_frame_begin() {
+	if (!C) {
+		return 0;
+	}
+
+	_lock_all();
+	if (++C->scope_count == 0) {
+		++C->scope_count;
+	}
+	C->scope = C->scope_count;
+	for (int i = 0; i < C->shard_count; ++i) {
+		C->shards[i].bmp_held = C->shards[i].gly_held = 0;
+	}
+	_drop_held_regions();
+	_unlock_all();
+
+	return gtxt_glyph_begin_frame();
+}
+
+void
+gtxt_glyph_frame_end() {
+	if (!C) {
+		return;
+	}
+
+	// entries over the caps are evicted by the next misses
+	_lock_all();
+	C->scope = 0;
+	for (int i = 0; i < C->shard_count; ++i) {
+		C->shards[i].bmp_held = C->shards[i].gly_held = 0;
+	}
+	_drop_held_regions();
+	_unlock_all();
+}
+
+void
+gtxt_glyph_set_bitmap_budget(size_t bytes) {
+	if (!C) {
+		return;
+	}
+
+	C->bmp_budget = bytes;
+	for (int i = 0; i < C->shard_count; ++i) {
+		struct glyph_shard* s = &C->shards[i];
+		_lock(&s->lock);
+		s->bmp_budget = bytes / C->shard_count;
+		if (bytes > 0 && s->bmp_budget == 0) {
+			s->bmp_budget = 1;
+		}
+		// over budget until the pins or the frame scope let go
+		if (s->bmp_budget > 0) {
+			_bitmap_fit(s, 0, NULL);
+		}
+		_unlock(&s->lock);
+	}
+}
+
+size_t
+gtxt_glyph_get_bitmap_budget() {
+	return C ? C->bmp_budget : 0;
+}
+
+size_t
+gtxt_glyph_get_bitmap_bytes() {
+	if (!C) {
+		return 0;
+	}
+
+	size_t bytes = 0;
+	for (int i = 0; i < C->shard_count; ++i) {
+		struct glyph_shard* s = &C->shards[i];
+		_lock(&s->lock);
+		bytes += s->bmp_bytes;
+		_unlock(&s->lock);
+	}
+	return bytes;
+}
+
+static inline void
+_cache_stats_add(struct gtxt_glyph_cache_stats* dst, const struct gtxt_glyph_cache_stats* src) {
+	dst->hits += src->hits;
+	dst->misses += src->misses;
+	dst->evictions += src->evictions;
+	dst->bytes += src->bytes;
+	dst->pinned += src->pinned;
+	dst->pinned_bytes += src->pinned_bytes;
+}
+
+static inline void
+_stats_add(struct gtxt_glyph_stats* dst, const struct gtxt_glyph_stats* src) {
+	_cache_stats_add(&dst->layout, &src->layout);
+	_cache_stats_add(&dst->bitmap, &src->bitmap);
+	dst->raster_plain += src->raster_plain;
+	dst->raster_edge += src->raster_edge;
+	dst->disk_loads += src->disk_loads;
+	dst->cold_loads += src->cold_loads;
+}
+
+void
+gtxt_glyph_get_stats(struct gtxt_glyph_stats* stats) {
+	memset(stats, 0, sizeof(*stats));
+	stats->font = stats->font_size = -1;
+	if (!C) {
+		return;
+	}
+
+	uint64_t lookups = 0, probes = 0;
+	for (int i = 0; i < C->shard_count; ++i) {
+		struct glyph_shard* s = &C->shards[i];
+		_lock(&s->lock);
+		for (int j = 0; j <= STAT_SLOTS; ++j) {
+			if (s->stats[j].used) {
+				_stats_add(stats, &s->stats[j].s);
+			}
+		}
+		struct gtxt_hash_stats hs;
+		gtxt_hash_get_stats(s->hash, &hs);
+		lookups += hs.lookups;
+		probes += hs.probes;
+		stats->probe_max = MAX(stats->probe_max, hs.max_probe);
+		_unlock(&s->lock);
+	}
+	stats->probe_avg = lookups > 0 ? (float)((double)probes / lookups) : 0;
+}
+
+int
+gtxt_glyph_get_font_stats(struct gtxt_glyph_stats* stats, int cap) {
+	if (!C) {
+		return 0;
+	}
+
+	int count = 0;
+	for (int i = 0; i < C->shard_count; ++i) {
+		struct glyph_shard* s = &C->shards[i];
+		_lock(&s->lock);
+		for (int j = 0; j <= STAT_SLOTS; ++j) {
+			const struct glyph_stats* src = &s->stats[j];
+			if (!src->used) {
+				continue;
+			}
+			int k = 0;
+			for ( ; k < count; ++k) {
+				if (stats[k].font == src->s.font && stats[k].font_size == src->s.font_size) {
+					break;
+				}
+			}
+			if (k == count) {
+				if (count == cap) {
+					continue;
+				}
+				memset(&stats[k], 0, sizeof(stats[k]));
+				stats[k].font = src->s.font;
+				stats[k].font_size = src->s.font_size;
+				++count;
+			}
+			_stats_add(&stats[k], &src->s);
+		}
+		_unlock(&s->lock);
+	}
+	return count;
+}
+
+void
+gtxt_glyph_reset_stats() {
+	if (!C) {
+		return;
+	}
+
+	for (int i = 0; i < C->shard_count; ++i) {
+		struct glyph_shard* s = &C->shards[i];
+		_lock(&s->lock);
+		for (int j = 0; j <= STAT_SLOTS; ++j) {
+			// resident bytes stay
+			struct gtxt_glyph_stats* st = &s->stats[j].s;
+			st->layout.hits = st->layout.misses = st->layout.evictions = 0;
+			st->bitmap.hits = st->bitmap.misses = st->bitmap.evictions = 0;
+			st->raster_plain = st->raster_edge = 0;
+			st->disk_loads = st->cold_loads = 0;
+		}
+		gtxt_hash_reset_stats(s->hash);
+		_unlock(&s->lock);
+	}
+}
+
+const void*
+gtxt_glyph_get_atlas_page(int page, int* width, int* height, bool* dirty) {
+	if (!C || !C->atlas) {
+		return NULL;
+	}
+	_lock(&C->atlas_lock);
+	const void* pixels = gtxt_atlas_get_page(C->atlas, page, width, height, dirty);
+	_unlock(&C->atlas_lock);
+	return pixels;
+}
+
+int
+gtxt_glyph_get_atlas_page_count() {
+	if (!C || !C->atlas) {
+		return 0;
+	}
+	_lock(&C->atlas_lock);
+	int count = gtxt_atlas_get_page_count(C->atlas);
+	_unlock(&C->atlas_lock);
+	return count;
+}
+
+static inline void
+_glyph_evict(struct glyph_shard* s, struct glyph* g) {
+	DS_FREELIST_PUSH_NODE_TO_FREELIST(s->gly_buf, g);
+	--s->gly_count;
+	// stale handles
+	g->version = g->version % HANDLE_VERSION_MAX + 1;
+	gtxt_hash_remove(s->hash, g->hash, g);
+	struct gtxt_glyph_stats* st = _stat(s, g->stat);
+	++st->layout.evictions;
+	st->layout.bytes -= sizeof(struct glyph);
+	// nobody else can reach its bitmap
+	if (g->bitmap && g->bitmap->version == g->bmp_version) {
+		_bitmap_release(s, g->bitmap);
+	}
+	g->bitmap = NULL;
+	_style_release(g->key.style);
+}
+
+// NULL if the shard can't grow past a frame scope holding all of it
+static inline struct glyph*
+_new_node(struct glyph_shard* s) {
+	// down to a lowered cap a few at a time, and room for one
+	for (int i = 0; i < RESIZE_STEP && s->gly_count >= s->cap_layout; ++i) {
+		struct glyph* g = _glyph_victim(s);
+		if (!g) {
+			break;
+		}
+		_glyph_evict(s, g);
+	}
+	if (!s->gly_buf.freelist) {
+		struct glyph* g = _glyph_victim(s);
+		if (g) {
+			_glyph_evict(s, g);
+		} else {
+			// all held by the frame scope, over the cap until it ends
+			if (!_shard_grow(s, s->bmp_alloc, s->gly_alloc + OVERFLOW_NODES)) {
+				return NULL;
+			}
+		}
+	}
+
+	struct glyph* g = NULL;
+	DS_FREELIST_POP_NODE_FROM_FREELIST(s->gly_buf, g);
+	++s->gly_count;
+	if (g->version == 0) {
+		g->version = 1;
+	}
+	g->scope = 0;
+	_hold_glyph(s, g);
+	g->bitmap = NULL;
+	g->bmp_version = 0;
+	g->frame = C->frame;
+	g->reused = false;
+
+	return g;
+}
+
+// false if the table can't grow, the node is given back
+static inline bool
+_node_init(struct glyph_shard* s, struct glyph* g, const struct glyph_key* key, uint64_t hash) {
+	if (!gtxt_hash_insert(s->hash, hash, g)) {
+		if (_is_glyph_held(g)) {
+			--s->gly_held;
+		}
+		g->scope = 0;
+		DS_FREELIST_PUSH_NODE_TO_FREELIST(s->gly_buf, g);
+		--s->gly_count;
+		return false;
+	}
+	g->key = *key;
+	g->hash = hash;
+
+	_style_acquire(key->style);
+	const struct gtxt_glyph_style* style = _key_style(key);
+	g->font_gen = _font_gen(style->font);
+	g->stat = _stat_find(s, style->font, style->font_size);
+	struct gtxt_glyph_stats* st = _stat(s, g->stat);
+	++st->layout.misses;
+	st->layout.bytes += sizeof(struct glyph);
+	return true;
+}
+
+// user fonts are left to the other modes
+static inline bool
+_is_sdf(const struct gtxt_glyph_style* style) {
+	return C->sdf_size > 0 && style->font >= 0 && style->font < gtxt_ft_get_font_cout();
+}
+
+static inline int
+_get_channels(const struct gtxt_glyph_style* style) {
+	if (_is_sdf(style)) {
+		return 1;
+	}
+	return C->coverage ? ((C->atlas || style->edge) ? 2 : 1) : 4;
+}
+
+// gradients only shift with line_x when they are slanted
+static inline bool
+_is_positional(const struct gtxt_glyph_color* col) {
+	switch (col->mode_type)
+	{
+	case 1:
+		return tanf(col->mode.TWO.angle) != 0;
+	case 2:
+		return tanf(col->mode.THREE.angle) != 0;
+	default:
+		return false;
+	}
+}
+
+static inline float
+_key_line_x(float line_x, const struct gtxt_glyph_style* style) {
+	if (!_is_positional(&style->font_color) && !(style->edge && _is_positional(&style->edge_color))) {
+		return 0;
+	}
+	if (C->line_x_step > 0) {
+		return floorf(line_x / C->line_x_step) * C->line_x_step;
+	}
+	return line_x;
+}
+
+// the last style a thread looked up, text comes in runs of one style
+struct style_memo {
+	unsigned int generation, epoch;
+	int ft_count;
+	struct gtxt_glyph_style raw;
+	int id;
+};
+
+static GTXT_THREAD_LOCAL struct style_memo STYLE_MEMO;
+
+void
+gtxt_glyph_thread_release() {
+	struct style_memo* m = &STYLE_MEMO;
+	if (C && m->generation == C->generation) {
+		_style_release(m->id);
+	}
+	memset(m, 0, sizeof(*m));
+}
+
+// the style id stays valid until the thread's next call, false if out of memory
+static inline bool
+_make_key(struct glyph_key* key, int unicode, float line_x, const struct gtxt_glyph_style* style) {
+	key->unicode = unicode;
+	key->line_x = _key_line_x(line_x, style);
+	if (_is_sdf(style) || C->coverage) {
+		key->line_x = 0;
+	}
+
+	struct style_memo* m = &STYLE_MEMO;
+	int ft_count = gtxt_ft_get_font_cout();
+	if (m->generation != C->generation
+	 || m->epoch != C->style_epoch
+	 || m->ft_count != ft_count
+	 || !_is_style_same(&m->raw, style)) {
+		struct gtxt_glyph_style s = *style;
+		if (_is_sdf(style)) {
+			memset(&s, 0, sizeof(s));
+			s.font = style->font;
+		} else if (C->coverage) {
+			memset(&s.font_color, 0, sizeof(s.font_color));
+			memset(&s.edge_color, 0, sizeof(s.edge_color));
+		}
+		int id = _style_intern(&s);
+		if (id < 0) {
+			return false;
+		}
+		if (m->generation == C->generation) {
+			_style_release(m->id);
+		}
+		m->generation = C->generation;
+		m->epoch = C->style_epoch;
+		m->ft_count = ft_count;
+		m->raw = *style;
+		m->id = id;
+	}
+	key->style = m->id;
+	return true;
+}
+
+float
+gtxt_glyph_scale_style(const struct gtxt_glyph_style* style, float scale, struct gtxt_glyph_style* scaled) {
+	*scaled = *style;
+	if (!C || scale <= 0 || style->font_size <= 0) {
+		return scale;
+	}
+
+	float size = style->font_size * scale;
+	// one field serves all sizes
+	if (_is_sdf(style)) {
+		scaled->font_size = MAX(1, (int)roundf(size));
+		return size / scaled->font_size;
+	}
+	if (C->scale_steps == 0) {
+		return scale;
+	}
+
+	// the step at or above, drawn down rather than up
+	int steps = C->scale_steps;
+	float step = ceilf(log2f(scale) * steps - 1e-4f);
+	step = MAX(step, (float)(-SCALE_OCTAVES * steps));
+	step = MIN(step, (float)(SCALE_OCTAVES * steps));
+	float level = exp2f(step / steps);
+
+	scaled->font_size = MAX(1, (int)roundf(style->font_size * level));
+	float ratio = (float)scaled->font_size / style->font_size;
+	scaled->edge_size = style->edge_size * ratio;
+	return scale / ratio;
+}
+
+// coverage doesn't depend on the color format, user font glyphs aren't saved
+static inline uint32_t
+_disk_flags() {
+	if (C->sdf_size > 0) {
+		return DISK_FLAG_SDF | (uint32_t)C->sdf_size << 8 | (uint32_t)C->sdf_spread << 20;
+	} else if (C->coverage) {
+		return DISK_FLAG_COVERAGE;
+	} else {
+		return gtxt_ft_is_premultiplied() ? DISK_FLAG_PREMULTIPLIED : 0;
+	}
+}
+
+static const struct disk_record*
+_disk_query(const struct glyph_key* key, uint64_t hash) {
+	if (!C->disk || gtxt_disk_get_flags(C->disk) != _disk_flags() || _is_disk_font_stale(_key_style(key)->font)) {
+		return NULL;
+	}
+
+	size_t sz = 0;
+	const struct disk_record* rec = (const struct disk_record*)gtxt_disk_query(C->disk, hash, key, _disk_equal_func, &sz);
+	if (!rec
+	 || rec->w < 0 || rec->h < 0 || rec->channels < 0 || rec->channels > 4
+	 || sz < sizeof(*rec) + (size_t)rec->w * rec->h * rec->channels) {
+		return NULL;
+	}
+	return rec;
+}
+
+static void
+_gen_layout(struct glyph* g) {
+	const struct glyph_key* key = &g->key;
+	const struct gtxt_glyph_style* style = _key_style(key);
+	_lock(&C->ft_lock);
+	int ft_count = gtxt_ft_get_font_cout();
+	if (_is_sdf(style)) {
+		gtxt_ft_get_sdf_layout(key->unicode, style->font, C->sdf_size, C->sdf_spread, &g->layout);
+	} else if (style->font < ft_count) {
+		gtxt_ft_get_layout(key->unicode, key->line_x, style, &g->layout);
+	} else {
+		GET_UF_LAYOUT(key->unicode, ft_count - style->font, &g->layout);
+	}
+	_unlock(&C->ft_lock);
+}
+
+static struct glyph*
+_query_layout(struct glyph_shard* s, const struct glyph_key* key, uint64_t hash) {
+	struct glyph* g = (struct glyph*)gtxt_hash_query(s->hash, hash, key, _equal_func);
+	if (g) {
+		_touch_glyph(s, g);
+		++_stat(s, g->stat)->layout.hits;
+		return g;
+	}
+
+	g = _new_node(s);
+	if (!g || !_node_init(s, g, key, hash)) {
+		return NULL;
+	}
+
+	const struct disk_record* rec = _disk_query(key, hash);
+	if (rec) {
+		g->layout = rec->layout;
+	} else {
+		_gen_layout(g);
+	}
+	return g;
+}
+
+// from the padded field at the reference size to the style's size and edge
+static inline void
+_sdf_scale_layout(const struct gtxt_glyph_layout* src, const struct gtxt_glyph_style* style, struct gtxt_glyph_layout* dst) {
+	float scale = (float)style->font_size / C->sdf_size;
+	float edge = style->edge ? style->edge_size : 0;
+	float spread = (float)C->sdf_spread;
+	if (src->sizer.width > 0 && src->sizer.height > 0) {
+		dst->sizer.width = floorf((src->sizer.width - spread * 2) * scale + edge * 2 + 0.5f);
+		dst->sizer.height = floorf((src->sizer.height - spread * 2) * scale + edge * 2 + 0.5f);
+		dst->bearing_x = (src->bearing_x + spread) * scale - edge;
+		dst->bearing_y = (src->bearing_y - spread) * scale + edge;
+	} else {
+		dst->sizer.width = dst->sizer.height = 0;
+		dst->bearing_x = src->bearing_x * scale;
+		dst->bearing_y = src->bearing_y * scale;
+	}
+	dst->advance = src->advance * scale + edge * 2;
+	dst->metrics_height = src->metrics_height * scale + edge * 2;
+}
+
+// layout of what is emitted for the style
+static inline void
+_get_emit_layout(const struct glyph* g, const struct gtxt_glyph_style* style, struct gtxt_glyph_layout* layout) {
+	if (_is_sdf(style)) {
+		_sdf_scale_layout(&g->layout, style, layout);
+	} else {
+		*layout = g->layout;
+	}
+}
+
+struct gtxt_glyph_layout*
+gtxt_glyph_get_layout(int unicode, float line_x, const struct gtxt_glyph_style* style) {
+	if (!C) {
+		return NULL;
+	}
+
+	struct glyph_key key;
+	if (!_make_key(&key, unicode, line_x, style)) {
+		return NULL;
+	}
+	uint64_t hash = _hash_key(&key);
+	struct glyph_shard* s = _get_shard(hash);
+
+	// scaled per call in sdf mode
+	static GTXT_THREAD_LOCAL struct gtxt_glyph_layout scaled;
+
+	_lock(&s->lock);
+	struct glyph* g = _query_layout(s, &key, hash);
+	struct gtxt_glyph_layout* ret = g ? &g->layout : NULL;
+	if (g && _is_sdf(style)) {
+		_sdf_scale_layout(&g->layout, style, &scaled);
+		ret = &scaled;
+	}
+	_unlock(&s->lock);
+
+	return ret;
+}
+
+bool
+gtxt_glyph_query_layout(int unicode, float line_x, const struct gtxt_glyph_style* style, struct gtxt_glyph_layout* layout) {
+	if (!C) {
+		return false;
+	}
+
+	struct glyph_key key;
+	if (!_make_key(&key, unicode, line_x, style)) {
+		return false;
+	}
+	uint64_t hash = _hash_key(&key);
+	struct glyph_shard* s = _get_shard(hash);
+
+	_lock(&s->lock);
+	struct glyph* g = _query_layout(s, &key, hash);
+	if (g) {
+		_get_emit_layout(g, style, layout);
+	}
+	_unlock(&s->lock);
+
+	return g != NULL;
+}
+
+// slab block of at least sz bytes, kept if it is of the same size class,
+// others are evicted to stay under budget
+static inline bool
+_bitmap_alloc(struct glyph_shard* s, struct glyph_bitmap* bmp, size_t sz) {
+	bmp->spans = false;
+	size_t block = gtxt_slab_block_size(sz);
+	if (block == bmp->sz && !bmp->mapped) {
+		return true;
+	}
+
+	_bitmap_free_buf(s, bmp);
+	// the bitmap being filled is off the list
+	if (s->bmp_budget > 0 && !_bitmap_fit(s, sz, bmp)) {
+		return false;
+	}
+	if (block > 0) {
+		bmp->buf = gtxt_slab_alloc(s->slab, sz);
+		if (!bmp->buf) {
+			return false;
+		}
+		bmp->sz = block;
+		s->bmp_bytes += block;
+	}
+	return true;
+}
+
+static inline bool
+_bitmap_store(struct glyph_shard* s, struct glyph_bitmap* bmp, const void* buf, int w, int h, int bpp) {
+	if (C->atlas && (w <= 0 || h <= 0)) {
+		// nothing to pack, such as spaces
+		bmp->region.page = -1;
+	} else if (C->atlas && bpp != C->atlas_bpp) {
+		// user font glyphs in sdf mode
+		return false;
+	} else if (C->atlas) {
+		_lock(&C->atlas_lock);
+		bool succ = gtxt_atlas_alloc(C->atlas, w, h, &bmp->region);
+		if (succ) {
+			gtxt_atlas_write(C->atlas, &bmp->region, buf);
+		}
+		_unlock(&C->atlas_lock);
+		if (!succ) {
+			return false;
+		}
+	} else {
+		size_t sz = (size_t)w * h * bpp;
+		if (!_bitmap_alloc(s, bmp, sz)) {
+			return false;
+		}
+		if (sz > 0) {
+			memcpy(bmp->buf, buf, sz);
+		}
+	}
+	_bitmap_validate(s, bmp, w, h, bpp);
+	return true;
+}
+
+// call with the shard locked
+static inline uint8_t*
+_prepare_span_buf(struct glyph_shard* s, size_t sz) {
+	if (s->span_buf_sz < sz) {
+		free(s->span_buf);
+		s->span_buf = (uint8_t*)malloc(sz);
+		s->span_buf_sz = s->span_buf ? sz : 0;
+	}
+	return s->span_buf;
+}
+
+// span encoded in span mode, unless that is no smaller
+static inline bool
+_bitmap_store_cov(struct glyph_shard* s, struct glyph_bitmap* bmp, const uint8_t* cov, int w, int h, int channels) {
+	size_t raw = (size_t)w * h * channels;
+	if (!C->spans || !C->coverage || C->atlas || !cov || raw == 0) {
+		return _bitmap_store(s, bmp, cov, w, h, channels);
+	}
+
+	uint8_t* tmp = _prepare_span_buf(s, raw);
+	size_t sz = tmp ? gtxt_span_encode(cov, w, h, channels, tmp, raw) : raw;
+	if (sz >= raw) {
+		return _bitmap_store(s, bmp, cov, w, h, channels);
+	}
+	if (!_bitmap_alloc(s, bmp, sz)) {
+		return false;
+	}
+	memcpy(bmp->buf, tmp, sz);
+	bmp->spans = true;
+	bmp->span_sz = sz;
+	_bitmap_validate(s, bmp, w, h, channels);
+	return true;
+}
+
+// of a heap bitmap, span encoded ones are decoded into the shard's buffer,
+// valid until its next use
+static inline const void*
+_bitmap_pixels(struct glyph_shard* s, const struct glyph_bitmap* bmp) {
+	if (!bmp->spans) {
+		return bmp->buf;
+	}
+	uint8_t* dst = _prepare_span_buf(s, (size_t)bmp->w * bmp->h * bmp->channels);
+	if (!dst || !gtxt_span_decode((const uint8_t*)bmp->buf, bmp->span_sz, bmp->w, bmp->h, bmp->channels, dst)) {
+		return NULL;
+	}
+	return dst;
+}
+
+// shared by all shards, call with the ft lock held
+static inline uint8_t*
+_prepare_cov_buf(size_t sz) {
+	if (C->cov_sz < sz) {
+		free(C->cov_buf);
+		C->cov_buf = (uint8_t*)malloc(sz);
+		C->cov_sz = C->cov_buf ? sz : 0;
+	}
+	return C->cov_buf;
+}
+
+// the rasterizer draws into the bitmap's heap buffer or atlas region
+struct raster_target {
+	struct gtxt_ft_target ft;
+
+	struct glyph_shard* s;
+	struct glyph_bitmap* bmp;
+
+	void* dst;
+	bool failed;
+	bool atlas_locked;
+	// drawn into cov_buf then encoded, ft lock held
+	bool spans;
+};
+
+static void*
+_raster_alloc(int w, int h, int bpp, int* stride, void* ud) {
+	struct raster_target* rt = (struct raster_target*)ud;
+	struct glyph_bitmap* bmp = rt->bmp;
+	if (rt->spans) {
+		*stride = w * bpp;
+		rt->dst = _prepare_cov_buf((size_t)w * h * bpp);
+		rt->failed = !rt->dst;
+		return rt->dst;
+	}
+	if (!C->atlas) {
+		*stride = w * bpp;
+		rt->dst = _bitmap_alloc(rt->s, bmp, (size_t)w * h * bpp) ? bmp->buf : NULL;
+		rt->failed = !rt->dst;
+		return rt->dst;
+	}
+
+	// held until the glyph is drawn
+	_lock(&C->atlas_lock);
+	rt->atlas_locked = true;
+	if (bpp == C->atlas_bpp && gtxt_atlas_alloc(C->atlas, w, h, &bmp->region)) {
+		rt->dst = gtxt_atlas_map(C->atlas, &bmp->region, stride);
+	}
+	rt->failed = !rt->dst;
+	return rt->dst;
+}
+
+static inline void
+_raster_begin(struct raster_target* rt, struct glyph_shard* s, struct glyph_bitmap* bmp) {
+	rt->ft.alloc = _raster_alloc;
+	rt->ft.ud = rt;
+	rt->s = s;
+	rt->bmp = bmp;
+	rt->dst = NULL;
+	rt->failed = false;
+	rt->atlas_locked = false;
+	rt->spans = false;
+}
+
+static inline void
+_raster_end(struct raster_target* rt, bool succ, int w, int h, int bpp) {
+	if (rt->atlas_locked) {
+		_unlock(&C->atlas_lock);
+		rt->atlas_locked = false;
+	}
+	if (!succ) {
+		return;
+	}
+
+	struct glyph_bitmap* bmp = rt->bmp;
+	if (!rt->dst && w > 0 && h > 0) {
+		// sized but nothing drawn, keep it blank
+		int stride;
+		uint8_t* dst = (uint8_t*)_raster_alloc(w, h, bpp, &stride, rt);
+		for (int y = 0; dst && y < h; ++y) {
+			memset(dst + (size_t)y * stride, 0, (size_t)w * bpp);
+		}
+		if (rt->atlas_locked) {
+			_unlock(&C->atlas_lock);
+			rt->atlas_locked = false;
+		}
+		if (!dst) {
+			return;
+		}
+	} else if (!rt->dst) {
+		_bitmap_store(rt->s, bmp, NULL, w, h, bpp);
+		return;
+	}
+
+	if (rt->spans) {
+		_bitmap_store_cov(rt->s, bmp, (const uint8_t*)rt->dst, w, h, bpp);
+	} else {
+		_bitmap_validate(rt->s, bmp, w, h, bpp);
+	}
+}
+
+static inline bool
+_bitmap_is_valid(struct glyph_shard* s, struct glyph_bitmap* bmp) {
+	if (!bmp->valid) {
+		return false;
+	}
+	if (C->atlas && bmp->region.page != -1) {
+		_lock(&C->atlas_lock);
+		bool valid = gtxt_atlas_is_valid(C->atlas, &bmp->region);
+		_unlock(&C->atlas_lock);
+		// the atlas page has been recycled
+		if (!valid) {
+			++_stat(s, bmp->stat)->bitmap.evictions;
+			_journal_add(s, bmp, GTXT_GLYPH_EVICTED);
+			_bitmap_set_bytes(s, bmp, 0);
+			bmp->valid = false;
+		}
+		return valid;
+	}
+	return true;
+}
+
+static inline void
+_prepare_emit_buf(size_t sz) {
+	if (C->emit_sz < sz) {
+		free(C->emit_buf);
+		C->emit_buf = (uint32_t*)malloc(sz);
+		C->emit_sz = C->emit_buf ? sz : 0;
+	}
+}
+
+// call with the ft lock held
+static bool
+_sdf_emit(const struct glyph* g, const uint8_t* field, float line_x, const struct gtxt_glyph_style* style, uint32_t* dst) {
+	struct gtxt_glyph_layout out;
+	_sdf_scale_layout(&g->layout, style, &out);
+	int w = (int)out.sizer.width,
+		h = (int)out.sizer.height;
+	int channels = style->edge ? 2 : 1;
+	uint8_t* cov = _prepare_cov_buf((size_t)w * h * channels);
+	if (!cov) {
+		return false;
+	}
+
+	float scale = (float)style->font_size / C->sdf_size;
+	gtxt_ft_sdf_to_coverage(field, (int)g->layout.sizer.width, (int)g->layout.sizer.height, C->sdf_spread, scale,
+		style->edge ? style->edge_size : 0, cov, w, h, channels);
+	gtxt_ft_colorize(cov, channels, w, h, line_x, style, gtxt_ft_is_premultiplied(), dst);
+	return true;
+}
+
+static inline void
+_count_raster(struct glyph_shard* s, struct glyph* g) {
+	struct gtxt_glyph_stats* st = _stat(s, g->stat);
+	if (_key_style(&g->key)->edge) {
+		++st->raster_edge;
+	} else {
+		++st->raster_plain;
+	}
+}
+
+static inline void
+_gen_bitmap(struct glyph_shard* s, struct glyph* g, int unicode, float line_x, const struct gtxt_glyph_style* style) {
+	struct raster_target rt;
+	_raster_begin(&rt, s, g->bitmap);
+
+	_lock(&C->ft_lock);
+	bool succ = gtxt_ft_gen_char_to(unicode, line_x, style, &g->layout, &rt.ft);
+	if (succ) {
+		_count_raster(s, g);
+		g->bitmap->channels = 4;
+	}
+	_raster_end(&rt, succ, (int)g->layout.sizer.width, (int)g->layout.sizer.height, sizeof(uint32_t));
+
+	// not a freetype glyph, rather than out of room
+	uint32_t* buf = NULL;
+	if (!succ && !rt.failed && CHAR_GEN) {
+		buf = CHAR_GEN("", style, &g->layout);
+	}
+	if (buf) {
+		_count_raster(s, g);
+		g->bitmap->channels = 4;
+		_bitmap_store(s, g->bitmap, buf, (int)g->layout.sizer.width, (int)g->layout.sizer.height, sizeof(uint32_t));
+	}
+	_unlock(&C->ft_lock);
+}
+
+static inline void
+_gen_coverage(struct glyph_shard* s, struct glyph* g, int unicode, const struct gtxt_glyph_style* style) {
+	int channels = _get_channels(style);
+	struct raster_target rt;
+	_raster_begin(&rt, s, g->bitmap);
+	rt.spans = C->spans && !C->atlas;
+
+	_lock(&C->ft_lock);
+	bool succ = gtxt_ft_gen_coverage_to(unicode, style, &g->layout, channels, &rt.ft);
+	if (succ) {
+		_count_raster(s, g);
+		g->bitmap->channels = channels;
+	}
+	_raster_end(&rt, succ, (int)g->layout.sizer.width, (int)g->layout.sizer.height, channels);
+
+	const uint8_t* cov = NULL;
+	if (!succ && !rt.failed && CHAR_GEN) {
+		const union gtxt_color* rgba = (const union gtxt_color*)CHAR_GEN("", style, &g->layout);
+		if (rgba) {
+			// user font, take its alpha as fill coverage
+			size_t n = (size_t)(g->layout.sizer.width * g->layout.sizer.height);
+			if (_prepare_cov_buf(n * channels)) {
+				memset(C->cov_buf, 0, n * channels);
+				for (size_t i = 0; i < n; ++i) {
+					C->cov_buf[i * channels] = rgba[i].a;
+				}
+				cov = C->cov_buf;
+			}
+		}
+	}
+	if (cov) {
+		_count_raster(s, g);
+		g->bitmap->channels = channels;
+		_bitmap_store_cov(s, g->bitmap, cov, (int)g->layout.sizer.width, (int)g->layout.sizer.height, channels);
+	}
+	_unlock(&C->ft_lock);
+}
+
+static inline void
+_gen_sdf(struct glyph_shard* s, struct glyph* g, int unicode, const struct gtxt_glyph_style* style) {
+	struct raster_target rt;
+	_raster_begin(&rt, s, g->bitmap);
+
+	_lock(&C->ft_lock);
+	bool succ = gtxt_ft_gen_sdf_to(unicode, style->font, C->sdf_size, C->sdf_spread, &g->layout, &rt.ft);
+	if (succ) {
+		_count_raster(s, g);
+		g->bitmap->channels = 1;
+	}
+	_raster_end(&rt, succ, (int)g->layout.sizer.width, (int)g->layout.sizer.height, 1);
+	_unlock(&C->ft_lock);
+}
+
+static bool
+_load_disk(struct glyph_shard* s, struct glyph* g) {
+	const struct disk_record* rec = _disk_query(&g->key, g->hash);
+	int channels = _get_channels(_key_style(&g->key));
+	if (!rec || rec->channels != channels) {
+		return false;
+	}
+
+	const void* pixels = rec + 1;
+	struct glyph_bitmap* bmp = g->bitmap;
+	bmp->channels = channels;
+	if (C->atlas) {
+		if (!_bitmap_store(s, bmp, pixels, rec->w, rec->h, channels)) {
+			return false;
+		}
+	} else {
+		// served from the mapping
+		_bitmap_free_buf(s, bmp);
+		bmp->buf = (void*)pixels;
+		bmp->mapped = true;
+		_bitmap_validate(s, bmp, rec->w, rec->h, channels);
+	}
+	g->layout = rec->layout;
+
+	++_stat(s, g->stat)->disk_loads;
+	return true;
+}
+
+// takes the glyph's entry out of the cold tier into its bitmap
+static bool
+_load_cold(struct glyph_shard* s, struct glyph* g) {
+	if (!s->cold_head) {
+		return false;
+	}
+	struct cold_entry* e = (struct cold_entry*)gtxt_hash_query(s->cold_hash, g->hash, &g->key, _cold_equal_func);
+	if (!e) {
+		return false;
+	}
+	// storing may evict into the tier
+	_cold_unlink(s, e);
+
+	const struct gtxt_glyph_style* style = _key_style(&g->key);
+	struct glyph_bitmap* bmp = g->bitmap;
+	const uint8_t* data = (const uint8_t*)(e + 1);
+	size_t raw = (size_t)e->w * e->h * e->channels;
+	bool succ = false;
+	bmp->channels = e->channels;
+	if (C->atlas) {
+		const uint8_t* pixels = data;
+		if (e->spans) {
+			uint8_t* buf = _prepare_cold_buf(s, raw);
+			pixels = buf && gtxt_span_decode(data, e->sz, e->w, e->h, e->channels, buf) ? buf : NULL;
+		}
+		succ = pixels && _bitmap_store(s, bmp, pixels, e->w, e->h, e->channels);
+	} else if (e->spans && C->spans && C->coverage && !_is_sdf(style)) {
+		// already in the form kept
+		succ = _bitmap_alloc(s, bmp, e->sz);
+		if (succ) {
+			memcpy(bmp->buf, data, e->sz);
+			bmp->spans = true;
+			bmp->span_sz = e->sz;
+			_bitmap_validate(s, bmp, e->w, e->h, e->channels);
+		}
+	} else if (_bitmap_alloc(s, bmp, raw)) {
+		if (e->spans) {
+			succ = gtxt_span_decode(data, e->sz, e->w, e->h, e->channels, (uint8_t*)bmp->buf);
+		} else {
+			memcpy(bmp->buf, data, raw);
+			succ = true;
+		}
+		if (succ) {
+			_bitmap_validate(s, bmp, e->w, e->h, e->channels);
+		}
+	}
+	if (succ) {
+		g->layout = e->layout;
+		++_stat(s, g->stat)->cold_loads;
+	}
+
+	_cold_free(e);
+	return succ;
+}
+
+// false if the shard can't grow past a frame scope holding all of it
+static inline bool
+_bind_bitmap(struct glyph_shard* s, struct glyph* g) {
+	// the bitmap has been taken by another glyph
+	if (g->bitmap && g->bitmap->version != g->bmp_version) {
+		g->bitmap = NULL;
+		g->bmp_version = 0;
+	}
+
+	if (!g->bitmap) {
+		for (int i = 0; i < RESIZE_STEP && s->bmp_count >= s->cap_bitmap; ++i) {
+			struct glyph_bitmap* bmp = _bitmap_victim(s);
+			if (!bmp) {
+				break;
+			}
+			_bitmap_release(s, bmp);
+		}
+		// move first to freelist
+		if (!s->bmp_buf.freelist) {
+			assert(s->bmp_buf.head);
+			// shouldn't pass head directly!!
+			// DECONNECT_NODE may change the params
+			struct glyph_bitmap* bmp = _bitmap_victim(s);
+			if (bmp) {
+				_bitmap_release(s, bmp);
+			} else {
+				// all held by the frame scope, over the cap until it ends
+				if (!_shard_grow(s, s->bmp_alloc + OVERFLOW_NODES, s->gly_alloc)) {
+					return false;
+				}
+			}
+		}
+
+		g->bitmap = s->bmp_buf.freelist;
+		g->bmp_version = g->bitmap->version;
+
+		s->bmp_buf.freelist = s->bmp_buf.freelist->next;
+		++s->bmp_count;
+		_bitmap_clear(s, g->bitmap);
+		g->bitmap->frame = C->frame;
+		g->bitmap->reused = false;
+		g->bitmap->stat = g->stat;
+		g->bitmap->unicode = g->key.unicode;
+		g->bitmap->font = _key_style(&g->key)->font;
+		g->bitmap->font_size = _key_style(&g->key)->font_size;
+		g->bitmap->owner = g;
+		_hold_bitmap(s, g->bitmap);
+		_bitmap_set_pinned(s, g->bitmap, g->pins > 0);
+	}
+	return true;
+}
+
+static inline void
+_gen(struct glyph_shard* s, struct glyph* g, const struct gtxt_glyph_style* style) {
+	int unicode = g->key.unicode;
+	if (_is_sdf(style)) {
+		_gen_sdf(s, g, unicode, style);
+	} else if (C->coverage) {
+		_gen_coverage(s, g, unicode, style);
+	} else {
+		// as keyed, so hits draw the same
+		_gen_bitmap(s, g, unicode, g->key.line_x, style);
+	}
+}
+
+static bool _async_submit(const struct glyph_key* key, uint64_t hash, float line_x, const struct gtxt_glyph_style* style);
+
+// false defers the raster to a later frame, begin is 0 if time isn't limited
+static inline bool
+_budget_take(uint64_t* begin) {
+	*begin = 0;
+	if (C->frame_max_rasters <= 0 && C->frame_max_us <= 0) {
+		return true;
+	}
+
+	_lock(&C->ft_lock);
+	bool take = (C->frame_max_rasters <= 0 || C->frame_rasters < C->frame_max_rasters)
+			 && (C->frame_max_us <= 0 || C->frame_us < (uint64_t)C->frame_max_us);
+	if (take) {
+		++C->frame_rasters;
+	} else {
+		++C->frame_deferred;
+	}
+	bool timed = C->frame_max_us > 0;
+	_unlock(&C->ft_lock);
+
+	if (take && timed) {
+		*begin = gtxt_time_us();
+	}
+	return take;
+}
+
+static inline void
+_budget_spend(uint64_t begin) {
+	if (begin == 0) {
+		return;
+	}
+	uint64_t us = gtxt_time_us() - begin;
+	_lock(&C->ft_lock);
+	C->frame_us += us;
+	_unlock(&C->ft_lock);
+}
+
+// call with the shard locked, NULL if out of memory
+static struct glyph*
+_query_bitmap(struct glyph_shard* s, const struct glyph_key* key, uint64_t hash,
+			  float line_x, const struct gtxt_glyph_style* style, struct gtxt_glyph_layout* layout) {
+	struct glyph* g = (struct glyph*)gtxt_hash_query(s->hash, hash, key, _equal_func);
+	bool found = g != NULL;
+	if (found) {
+		_touch_glyph(s, g);
+		++_stat(s, g->stat)->layout.hits;
+		*layout = g->layout;
+	} else {
+		g = _new_node(s);
+		if (!g || !_node_init(s, g, key, hash)) {
+			return NULL;
+		}
+	}
+
+	if (!_bind_bitmap(s, g)) {
+		// the node is kept with its layout
+		if (!found) {
+			_gen_layout(g);
+		}
+		return NULL;
+	}
+
+	if (_bitmap_is_valid(s, g->bitmap)) {
+		++_stat(s, g->stat)->bitmap.hits;
+	} else {
+		++_stat(s, g->stat)->bitmap.misses;
+		if (!_load_disk(s, g) && !_load_cold(s, g)) {
+			uint64_t begin;
+			if (_async_submit(key, hash, line_x, style) || !_budget_take(&begin)) {
+				// pending or over budget, only the metrics for now
+				if (!found) {
+					_gen_layout(g);
+				}
+				_get_emit_layout(g, style, layout);
+			} else {
+				_gen(s, g, style);
+				_budget_spend(begin);
+			}
+		}
+		if (g->bitmap->valid) {
+			*layout = g->layout;
+		}
+	}
+
+	_touch_bitmap(s, g->bitmap);
+	return g;
+}
+
+static inline gtxt_glyph_handle
+_handle_make(const struct glyph_shard* s, const struct glyph* g) {
+	uint64_t index = (uint64_t)g->id * (uint64_t)C->shard_count + (uint64_t)(s - C->shards);
+	if (index >> (64 - HANDLE_VERSION_BITS) != 0) {
+		return GTXT_GLYPH_HANDLE_NONE;
+	}
+	return index << HANDLE_VERSION_BITS | g->version;
+}
+
+static inline struct glyph_shard*
+_handle_shard(gtxt_glyph_handle handle) {
+	return &C->shards[(handle >> HANDLE_VERSION_BITS) % C->shard_count];
+}
+
+// call with its shard locked, NULL once the glyph is evicted
+static struct glyph*
+_handle_glyph(struct glyph_shard* s, gtxt_glyph_handle handle) {
+	int id = (int)((handle >> HANDLE_VERSION_BITS) / C->shard_count);
+	for (struct node_chunk* chunk = s->chunks; chunk; chunk = chunk->next) {
+		if (id >= chunk->first_glyph && id < chunk->first_glyph + chunk->glyph_count) {
+			struct glyph* g = &chunk->glyphs[id - chunk->first_glyph];
+			return g->version == (handle & HANDLE_VERSION_MAX) ? g : NULL;
+		}
+	}
+	return NULL;
+}
+
+gtxt_glyph_handle
+gtxt_glyph_acquire(int unicode, float line_x, const struct gtxt_glyph_style* style) {
+	if (!C) {
+		return GTXT_GLYPH_HANDLE_NONE;
+	}
+
+	struct glyph_key key;
+	if (!_make_key(&key, unicode, line_x, style)) {
+		return GTXT_GLYPH_HANDLE_NONE;
+	}
+	uint64_t hash = _hash_key(&key);
+	struct glyph_shard* s = _get_shard(hash);
+
+	_lock(&s->lock);
+	struct gtxt_glyph_layout layout;
+	struct glyph* g = _query_bitmap(s, &key, hash, line_x, style, &layout);
+	gtxt_glyph_handle handle = g ? _handle_make(s, g) : GTXT_GLYPH_HANDLE_NONE;
+	_unlock(&s->lock);
+
+	return handle;
+}
+
+bool
+gtxt_glyph_handle_layout(gtxt_glyph_handle handle, struct gtxt_glyph_layout* layout) {
+	if (!C || handle == GTXT_GLYPH_HANDLE_NONE) {
+		return false;
+	}
+
+	struct glyph_shard* s = _handle_shard(handle);
+	_lock(&s->lock);
+	// copied, the node may be reused once unlocked
+	struct glyph* g = _handle_glyph(s, handle);
+	if (g) {
+		*layout = g->layout;
+	}
+	_unlock(&s->lock);
+
+	return g != NULL;
+}
+
+const void*
+gtxt_glyph_handle_pixels(gtxt_glyph_handle handle, int* channels) {
+	if (!C || C->atlas || handle == GTXT_GLYPH_HANDLE_NONE) {
+		return NULL;
+	}
+
+	struct glyph_shard* s = _handle_shard(handle);
+	_lock(&s->lock);
+	const void* ret = NULL;
+	struct glyph* g = _handle_glyph(s, handle);
+	if (g && g->bitmap && g->bitmap->version == g->bmp_version && g->bitmap->valid && !g->bitmap->spans) {
+		if (channels) {
+			*channels = g->bitmap->channels;
+		}
+		ret = g->bitmap->buf;
+	}
+	_unlock(&s->lock);
+
+	return ret;
+}
+
+uint32_t*
+gtxt_glyph_get_bitmap(int unicode, float line_x, const struct gtxt_glyph_style* style, struct gtxt_glyph_layout* layout) {
+	if (!C || C->atlas) {
+		return NULL;
+	}
+
+	struct glyph_key key;
+	if (!_make_key(&key, unicode, line_x, style)) {
+		return NULL;
+	}
+	uint64_t hash = _hash_key(&key);
+	struct glyph_shard* s = _get_shard(hash);
+
+	_lock(&s->lock);
+
+	uint32_t* ret = NULL;
+	struct glyph* g = _query_bitmap(s, &key, hash, line_x, style, layout);
+	if (!g || !g->bitmap->valid) {
+		ret = NULL;
+	} else if (_is_sdf(style)) {
+		_sdf_scale_layout(&g->layout, style, layout);
+		_lock(&C->ft_lock);
+		_prepare_emit_buf((size_t)layout->sizer.width * (size_t)layout->sizer.height * sizeof(uint32_t));
+		if (C->emit_buf && _sdf_emit(g, (const uint8_t*)g->bitmap->buf, line_x, style, C->emit_buf)) {
+			ret = C->emit_buf;
+		}
+		_unlock(&C->ft_lock);
+	} else if (!C->coverage) {
+		ret = (uint32_t*)g->bitmap->buf;
+	} else {
+		int w = (int)g->layout.sizer.width,
+			h = (int)g->layout.sizer.height;
+		// shared by all shards
+		_lock(&C->ft_lock);
+		_prepare_emit_buf((size_t)w * h * sizeof(uint32_t));
+		const uint8_t* cov = (const uint8_t*)_bitmap_pixels(s, g->bitmap);
+		if (C->emit_buf && cov) {
+			gtxt_ft_colorize(cov, g->bitmap->channels, w, h, line_x, style, gtxt_ft_is_premultiplied(), C->emit_buf);
+			ret = C->emit_buf;
+		}
+		_unlock(&C->ft_lock);
+	}
+
+	_unlock(&s->lock);
+	return ret;
+}
+
+// call with the shard locked
+static bool
+_copy_bitmap(struct glyph_shard* s, struct glyph* g, float line_x, const struct gtxt_glyph_style* style, uint32_t* dst) {
+	struct glyph_bitmap* bmp = g->bitmap;
+	int w = (int)g->layout.sizer.width,
+		h = (int)g->layout.sizer.height;
+	if (_is_sdf(style)) {
+		const uint8_t* field = (const uint8_t*)bmp->buf;
+		uint8_t* tmp = NULL;
+		if (C->atlas) {
+			tmp = (uint8_t*)malloc((size_t)w * h);
+			if (!tmp) {
+				return false;
+			}
+			_lock(&C->atlas_lock);
+			bool read = gtxt_atlas_read(C->atlas, &bmp->region, tmp);
+			_unlock(&C->atlas_lock);
+			if (!read) {
+				free(tmp);
+				return false;
+			}
+			field = tmp;
+		}
+		_lock(&C->ft_lock);
+		bool succ = _sdf_emit(g, field, line_x, style, dst);
+		_unlock(&C->ft_lock);
+		free(tmp);
+		return succ;
+	}
+
+	if (!C->atlas) {
+		if (C->coverage) {
+			const uint8_t* cov = (const uint8_t*)_bitmap_pixels(s, bmp);
+			if (!cov) {
+				return false;
+			}
+			gtxt_ft_colorize(cov, bmp->channels, w, h, line_x, style, gtxt_ft_is_premultiplied(), dst);
+		} else {
+			memcpy(dst, bmp->buf, (size_t)w * h * sizeof(uint32_t));
+		}
+		return true;
+	}
+
+	if (!C->coverage) {
+		_lock(&C->atlas_lock);
+		bool succ = gtxt_atlas_read(C->atlas, &bmp->region, dst);
+		_unlock(&C->atlas_lock);
+		return succ;
+	}
+
+	uint8_t* cov = (uint8_t*)malloc((size_t)w * h * bmp->channels);
+	if (!cov) {
+		return false;
+	}
+	_lock(&C->atlas_lock);
+	bool succ = gtxt_atlas_read(C->atlas, &bmp->region, cov);
+	_unlock(&C->atlas_lock);
+	if (succ) {
+		gtxt_ft_colorize(cov, bmp->channels, w, h, line_x, style, gtxt_ft_is_premultiplied(), dst);
+	}
+	free(cov);
+	return succ;
+}
+
+int
+gtxt_glyph_copy_bitmap(int unicode, float line_x, const struct gtxt_glyph_style* style, struct gtxt_glyph_layout* layout, uint32_t* dst, int dst_cap) {
+	if (!C) {
+		return 0;
+	}
+
+	struct glyph_key key;
+	if (!_make_key(&key, unicode, line_x, style)) {
+		return 0;
+	}
+	uint64_t hash = _hash_key(&key);
+	struct glyph_shard* s = _get_shard(hash);
+
+	_lock(&s->lock);
+
+	int n = 0;
+	// other shards may recycle the atlas page between query and read
+	for (int retry = 0; retry < 3; ++retry) {
+		struct glyph* g = _query_bitmap(s, &key, hash, line_x, style, layout);
+		if (!g || !g->bitmap->valid) {
+			break;
+		}
+		_get_emit_layout(g, style, layout);
+		n = (int)layout->sizer.width * (int)layout->sizer.height;
+		if (n == 0 || n > dst_cap || _copy_bitmap(s, g, line_x, style, dst)) {
+			break;
+		}
+		g->bitmap->valid = false;
+		n = 0;
+	}
+
+	_unlock(&s->lock);
+	return n;
+}
+
+// call with the shard locked
+static bool
+_copy_bitmap_fmt(struct glyph_shard* s, struct glyph* g, float line_x, const struct gtxt_glyph_style* style, const struct gtxt_glyph_output* out, void* dst) {
+	struct glyph_bitmap* bmp = g->bitmap;
+	struct gtxt_glyph_layout layout;
+	_get_emit_layout(g, style, &layout);
+	int w = (int)layout.sizer.width,
+		h = (int)layout.sizer.height;
+	int stride = out->stride > 0 ? out->stride : w * gtxt_glyph_format_bpp(out->format);
+
+	// fill coverage is the alpha already
+	if (out->format == GTXT_GLYPH_A8 && C->coverage && !C->atlas && bmp->channels == 1 && !_is_sdf(style)) {
+		const uint8_t* cov = (const uint8_t*)_bitmap_pixels(s, bmp);
+		if (!cov) {
+			return false;
+		}
+		for (int y = 0; y < h; ++y) {
+			int src_y = out->top_down ? h - 1 - y : y;
+			memcpy((uint8_t*)dst + (size_t)y * stride, cov + (size_t)src_y * w, w);
+		}
+		return true;
+	}
+
+	uint32_t* rgba = (uint32_t*)malloc((size_t)w * h * sizeof(uint32_t));
+	if (!rgba) {
+		return false;
+	}
+	bool succ = _copy_bitmap(s, g, line_x, style, rgba);
+	if (succ) {
+		gtxt_ft_convert(rgba, w, h, gtxt_ft_is_premultiplied(), out, dst);
+	}
+	free(rgba);
+	return succ;
+}
+
+size_t
+gtxt_glyph_copy_bitmap_fmt(int unicode, float line_x, const struct gtxt_glyph_style* style, const struct gtxt_glyph_output* out,
+						   struct gtxt_glyph_layout* layout, void* dst, size_t dst_sz) {
+	if (!C) {
+		return 0;
+	}
+
+	struct glyph_key key;
+	if (!_make_key(&key, unicode, line_x, style)) {
+		return 0;
+	}
+	uint64_t hash = _hash_key(&key);
+	struct glyph_shard* s = _get_shard(hash);
+
+	_lock(&s->lock);
+
+	size_t sz = 0;
+	for (int retry = 0; retry < 3; ++retry) {
+		struct glyph* g = _query_bitmap(s, &key, hash, line_x, style, layout);
+		if (!g || !g->bitmap->valid) {
+			break;
+		}
+		_get_emit_layout(g, style, layout);
+		int w = (int)layout->sizer.width,
+			h = (int)layout->sizer.height;
+		int row = w * gtxt_glyph_format_bpp(out->format);
+		if (w <= 0 || h <= 0 || (out->stride > 0 && out->stride < row)) {
+			break;
+		}
+		int stride = out->stride > 0 ? out->stride : row;
+		sz = (size_t)stride * (h - 1) + row;
+		if (sz > dst_sz || _copy_bitmap_fmt(s, g, line_x, style, out, dst)) {
+			break;
+		}
+		g->bitmap->valid = false;
+		sz = 0;
+	}
+
+	_unlock(&s->lock);
+	return sz;
+}
+
+const uint8_t*
+gtxt_glyph_get_coverage(int unicode, const struct gtxt_glyph_style* style, struct gtxt_glyph_layout* layout, int* channels) {
+	if (!C || !C->coverage || C->atlas || _is_sdf(style)) {
+		return NULL;
+	}
+
+	struct glyph_key key;
+	if (!_make_key(&key, unicode, 0, style)) {
+		return NULL;
+	}
+	uint64_t hash = _hash_key(&key);
+	struct glyph_shard* s = _get_shard(hash);
+
+	_lock(&s->lock);
+
+	const uint8_t* ret = NULL;
+	struct glyph* g = _query_bitmap(s, &key, hash, 0, style, layout);
+	if (g && g->bitmap->valid) {
+		if (channels) {
+			*channels = g->bitmap->channels;
+		}
+		ret = (const uint8_t*)_bitmap_pixels(s, g->bitmap);
+	}
+
+	_unlock(&s->lock);
+	return ret;
+}
+
+const uint8_t*
+gtxt_glyph_get_sdf(int unicode, const struct gtxt_glyph_style* style, struct gtxt_glyph_layout* layout) {
+	if (!C || C->atlas || !_is_sdf(style)) {
+		return NULL;
+	}
+
+	struct glyph_key key;
+	if (!_make_key(&key, unicode, 0, style)) {
+		return NULL;
+	}
+	uint64_t hash = _hash_key(&key);
+	struct glyph_shard* s = _get_shard(hash);
+
+	_lock(&s->lock);
+	struct glyph* g = _query_bitmap(s, &key, hash, 0, style, layout);
+	const uint8_t* ret = g && g->bitmap->valid ? (const uint8_t*)g->bitmap->buf : NULL;
+	_unlock(&s->lock);
+
+	return ret;
+}
+
+bool
+gtxt_glyph_get_region(int unicode, float line_x, const struct gtxt_glyph_style* style, struct gtxt_glyph_layout* layout, struct gtxt_glyph_region* region) {
+	if (!C || !C->atlas) {
+		return false;
+	}
+
+	struct glyph_key key;
+	if (!_make_key(&key, unicode, line_x, style)) {
+		return false;
+	}
+	uint64_t hash = _hash_key(&key);
+	struct glyph_shard* s = _get_shard(hash);
+
+	_lock(&s->lock);
+
+	struct glyph* g = _query_bitmap(s, &key, hash, line_x, style, layout);
+	if (!g || !g->bitmap->valid) {
+		_unlock(&s->lock);
+		return false;
+	}
+	if (g->bitmap->region.page == -1) {
+		// drawn, with nothing to pack
+		_unlock(&s->lock);
+		memset(region, 0, sizeof(*region));
+		region->page = -1;
+		return true;
+	}
+
+	struct gtxt_atlas_region r = g->bitmap->region;
+
+	_lock(&C->atlas_lock);
+	gtxt_atlas_touch(C->atlas, &r);
+	int page_w, page_h;
+	gtxt_atlas_get_page(C->atlas, r.page, &page_w, &page_h, NULL);
+	_unlock(&C->atlas_lock);
+
+	_unlock(&s->lock);
+
+	region->page = r.page;
+	region->x = r.x;
+	region->y = r.y;
+	region->w = r.w;
+	region->h = r.h;
+	region->u0 = (float)r.x / page_w;
+	region->v0 = (float)r.y / page_h;
+	region->u1 = (float)(r.x + r.w) / page_w;
+	region->v1 = (float)(r.y + r.h) / page_h;
+
+	return true;
+}
+
+// call with the shard locked
+static bool
+_pin(struct glyph_shard* s, const struct glyph_key* key, uint64_t hash, const struct gtxt_glyph_style* style) {
+	struct glyph* g = (struct glyph*)gtxt_hash_query(s->hash, hash, key, _equal_func);
+	// a glyph and a bitmap more
+	if ((!g || g->pins == 0)
+	 && (s->gly_pinned + 1 > s->cap_layout / 2 || s->bmp_pinned + 1 > s->cap_bitmap / 2)) {
+		return false;
+	}
+
+	bool found = g != NULL;
+	if (found) {
+		_touch_glyph(s, g);
 	} else {
-		*layout = g->layout;
-		size_t sz = (size_t)(g->layout.sizer.width * g->layout.sizer.height * sizeof(uint32_t));
-		if (sz > g->bitmap->sz) {
-			free(g->bitmap->buf);
-			g->bitmap->buf = malloc(sz);
-			g->bitmap->sz = sz;
+		g = _new_node(s);
+		if (!g || !_node_init(s, g, key, hash)) {
+			return false;
+		}
+	}
+
+	if (!_bind_bitmap(s, g)) {
+		if (!found) {
+			_gen_layout(g);
+		}
+		return false;
+	}
+
+	if (g->pins++ == 0) {
+		++s->gly_pinned;
+		struct gtxt_glyph_stats* st = _stat(s, g->stat);
+		++st->layout.pinned;
+		st->layout.pinned_bytes += sizeof(struct glyph);
+	}
+
+	_bitmap_set_pinned(s, g->bitmap, true);
+	if (!_bitmap_is_valid(s, g->bitmap) && !_load_disk(s, g)) {
+		_gen(s, g, style);
+	}
+	_touch_bitmap(s, g->bitmap);
+
+	return true;
+}
+
+// call with the shard locked
+static void
+_unpin(struct glyph_shard* s, const struct glyph_key* key, uint64_t hash) {
+	struct glyph* g = (struct glyph*)gtxt_hash_query(s->hash, hash, key, _equal_func);
+	if (!g || g->pins == 0 || --g->pins > 0) {
+		return;
+	}
+	_glyph_unpinned(s, g);
+}
+
+int
+gtxt_glyph_pin(const int* unicodes, int count, const struct gtxt_glyph_style* style) {
+	if (!C) {
+		return 0;
+	}
+
+	int pinned = 0;
+	for (int i = 0; i < count; ++i) {
+		struct glyph_key key;
+		if (!_make_key(&key, unicodes[i], 0, style)) {
+			continue;
+		}
+		uint64_t hash = _hash_key(&key);
+		struct glyph_shard* s = _get_shard(hash);
+		_lock(&s->lock);
+		if (_pin(s, &key, hash, style)) {
+			++pinned;
+		}
+		_unlock(&s->lock);
+	}
+	return pinned;
+}
+
+void
+gtxt_glyph_unpin(const int* unicodes, int count, const struct gtxt_glyph_style* style) {
+	if (!C) {
+		return;
+	}
+
+	for (int i = 0; i < count; ++i) {
+		struct glyph_key key;
+		if (!_make_key(&key, unicodes[i], 0, style)) {
+			continue;
+		}
+		uint64_t hash = _hash_key(&key);
+		struct glyph_shard* s = _get_shard(hash);
+		_lock(&s->lock);
+		_unpin(s, &key, hash);
+		_unlock(&s->lock);
+	}
+}
+
+static uint64_t*
+_get_font_checksums(int* count) {
+	*count = gtxt_ft_get_font_cout();
+	uint64_t* checksums = (uint64_t*)malloc(sizeof(uint64_t) * (*count > 0 ? *count : 1));
+	if (checksums) {
+		for (int i = 0; i < *count; ++i) {
+			checksums[i] = gtxt_ft_get_font_checksum(i);
+		}
+	}
+	return checksums;
+}
+
+// takes the shard locks, nothing may point into the old mapping
+static void
+_set_disk(struct gtxt_disk* disk) {
+	for (int i = 0; i < C->shard_count; ++i) {
+		_lock(&C->shards[i].lock);
+	}
+
+	for (int i = 0; i < C->shard_count; ++i) {
+		struct glyph_shard* s = &C->shards[i];
+		for (struct node_chunk* chunk = s->chunks; chunk; chunk = chunk->next) {
+			for (int j = 0; j < chunk->bitmap_count; ++j) {
+				struct glyph_bitmap* bmp = &chunk->bitmaps[j];
+				if (bmp->mapped) {
+					_bitmap_release(s, bmp);
+				}
+			}
+		}
+	}
+	gtxt_disk_close(C->disk);
+	C->disk = disk;
+	memcpy(C->disk_font_gens, C->font_gens, sizeof(C->font_gens));
+
+	for (int i = C->shard_count - 1; i >= 0; --i) {
+		_unlock(&C->shards[i].lock);
+	}
+}
+
+bool
+gtxt_glyph_load_cache(const char* filepath) {
+	if (!C) {
+		return false;
+	}
+
+	int font_count;
+	uint64_t* checksums = _get_font_checksums(&font_count);
+	if (!checksums) {
+		return false;
+	}
+	struct gtxt_disk* disk = gtxt_disk_open(filepath, DISK_FORMAT, checksums, font_count);
+	free(checksums);
+	if (!disk) {
+		return false;
+	}
+	_set_disk(disk);
+
+	return true;
+}
+
+static inline bool
+_is_bitmap_cached(struct glyph_shard* s, struct glyph* g) {
+	return g->bitmap && g->bitmap->version == g->bmp_version && _bitmap_is_valid(s, g->bitmap);
+}
+
+bool
+gtxt_glyph_save_cache(const char* filepath) {
+	if (!C) {
+		return false;
+	}
+
+	int font_count;
+	uint64_t* checksums = _get_font_checksums(&font_count);
+	if (!checksums) {
+		return false;
+	}
+	struct gtxt_disk_writer* w = gtxt_disk_writer_create(DISK_FORMAT, _disk_flags(), checksums, font_count);
+	free(checksums);
+	if (!w) {
+		return false;
+	}
+
+	bool succ = true;
+	uint8_t* tmp = NULL;
+	size_t tmp_sz = 0;
+	for (int i = 0; i < C->shard_count && succ; ++i) {
+		struct glyph_shard* s = &C->shards[i];
+		_lock(&s->lock);
+		for (struct glyph* g = s->gly_buf.head; g && succ; g = g->next) {
+			const struct gtxt_glyph_style* style = _key_style(&g->key);
+			// drawn from a font file the checksums no longer match
+			if (style->font < 0 || style->font >= font_count || _is_glyph_stale(g)) {
+				continue;
+			}
+
+			struct disk_record rec;
+			memset(&rec, 0, sizeof(rec));
+			rec.key.unicode = g->key.unicode;
+			rec.key.s = *style;
+			rec.key.line_x = g->key.line_x;
+			rec.layout = g->layout;
+
+			const void* pixels = NULL;
+			if (_is_bitmap_cached(s, g)) {
+				struct glyph_bitmap* bmp = g->bitmap;
+				rec.w = (int)g->layout.sizer.width;
+				rec.h = (int)g->layout.sizer.height;
+				rec.channels = bmp->channels;
+				if (C->atlas) {
+					size_t sz = (size_t)rec.w * rec.h * rec.channels;
+					if (sz > tmp_sz) {
+						free(tmp);
+						tmp = (uint8_t*)malloc(sz);
+						tmp_sz = tmp ? sz : 0;
+					}
+					_lock(&C->atlas_lock);
+					bool read = tmp && gtxt_atlas_read(C->atlas, &bmp->region, tmp);
+					_unlock(&C->atlas_lock);
+					pixels = read ? tmp : NULL;
+				} else {
+					pixels = _bitmap_pixels(s, bmp);
+				}
+				if (!pixels && rec.w * rec.h > 0) {
+					rec.w = rec.h = rec.channels = 0;
+				}
+			}
+
+			// keep the old one if it has the bitmap
+			if (rec.channels == 0) {
+				const struct disk_record* old = _disk_query(&g->key, g->hash);
+				if (old && old->channels != 0) {
+					continue;
+				}
+			}
+
+			size_t data_sz = (size_t)rec.w * rec.h * rec.channels;
+			succ = gtxt_disk_writer_add(w, g->hash, style->font, &rec, sizeof(rec), pixels, data_sz);
+		}
+		_unlock(&s->lock);
+	}
+	free(tmp);
+
+	// glyphs not used in this run
+	if (succ && C->disk && gtxt_disk_get_flags(C->disk) == _disk_flags()) {
+		for (int i = 0, n = gtxt_disk_count(C->disk); i < n && succ; ++i) {
+			uint64_t hash;
+			size_t sz;
+			const struct disk_record* rec = (const struct disk_record*)gtxt_disk_get(C->disk, i, &hash, &sz);
+			if (!rec || sz < sizeof(*rec) || _is_disk_font_stale(rec->key.s.font)) {
+				continue;
+			}
+
+			struct glyph_key key;
+			key.unicode = rec->key.unicode;
+			key.style = _style_intern(&rec->key.s);
+			key.line_x = rec->key.line_x;
+			bool saved = false;
+			if (key.style >= 0) {
+				struct glyph_shard* s = _get_shard(hash);
+				_lock(&s->lock);
+				struct glyph* g = (struct glyph*)gtxt_hash_query(s->hash, hash, &key, _equal_func);
+				saved = g && (rec->channels == 0 || _is_bitmap_cached(s, g));
+				_unlock(&s->lock);
+				_style_release(key.style);
+			}
+
+			if (!saved) {
+				succ = gtxt_disk_writer_add(w, hash, rec->key.s.font, rec, sz, NULL, 0);
+			}
+		}
+	}
+
+#ifdef _WIN32
+	// a mapped file can't be replaced, the records are copied by now; the
+	// saved file is loaded in its place
+	bool reload = succ && C->disk;
+	if (reload) {
+		_set_disk(NULL);
+	}
+#endif
+	if (succ) {
+		succ = gtxt_disk_writer_save(w, filepath);
+	}
+	gtxt_disk_writer_release(w);
+#ifdef _WIN32
+	if (reload && succ) {
+		gtxt_glyph_load_cache(filepath);
+	}
+#endif
+
+	return succ;
+}
+
+// drawn off the cache, by prewarm or async threads
+struct raster_job {
+	struct glyph_key key;
+	uint64_t hash;
+	// as asked for, the key holds it rounded
+	float line_x;
+	struct gtxt_glyph_style style;
+
+	struct gtxt_glyph_layout layout;
+	void* pixels;
+	int channels;
+	bool premultiplied;
+	int sdf_size, sdf_spread;
+	unsigned int font_gen;
+	bool done;
+
+	struct raster_job* next;
+};
+
+struct prewarm {
+	struct raster_job* jobs;
+	int count;
+	int next;
+	gtxt_mutex lock;
+};
+
+static inline bool
+_job_equal_func(const void* key, const void* val) {
+	return _is_key_same((const struct glyph_key*)key, &((const struct raster_job*)val)->key);
+}
+
+static inline void
+_job_init(struct raster_job* job, const struct glyph_key* key, uint64_t hash, float line_x, const struct gtxt_glyph_style* style) {
+	memset(job, 0, sizeof(*job));
+	job->key = *key;
+	job->line_x = line_x;
+	_style_acquire(key->style);
+	job->hash = hash;
+	job->style = *style;
+	job->channels = _get_channels(style);
+	job->premultiplied = gtxt_ft_is_premultiplied();
+	job->font_gen = _font_gen(style->font);
+	if (_is_sdf(style)) {
+		job->sdf_size = C->sdf_size;
+		job->sdf_spread = C->sdf_spread;
+	}
+}
+
+static bool
+_is_cached(const struct glyph_key* key, uint64_t hash, int channels) {
+	struct glyph_shard* s = _get_shard(hash);
+	_lock(&s->lock);
+	struct glyph* g = (struct glyph*)gtxt_hash_query(s->hash, hash, key, _equal_func);
+	bool cached = g && _is_bitmap_cached(s, g);
+	if (!cached) {
+		const struct disk_record* rec = _disk_query(key, hash);
+		cached = rec && rec->channels == channels;
+	}
+	_unlock(&s->lock);
+	return cached;
+}
+
+static void*
+_job_alloc(int w, int h, int bpp, int* stride, void* ud) {
+	struct raster_job* job = (struct raster_job*)ud;
+	*stride = w * bpp;
+	free(job->pixels);
+	job->pixels = malloc((size_t)w * h * bpp);
+	return job->pixels;
+}
+
+// no cache state is touched, may run on any thread; ctx is the thread's
+// own, NULL for the shared one
+static void
+_job_raster(struct gtxt_ft_context* ctx, struct raster_job* job) {
+	if (ctx) {
+		gtxt_ft_context_set_premultiplied(ctx, job->premultiplied);
+	}
+
+	struct gtxt_ft_target target;
+	target.alloc = _job_alloc;
+	target.ud = job;
+
+	bool succ = false;
+	if (job->sdf_size > 0) {
+		succ = gtxt_ft_gen_sdf_to(job->key.unicode, job->style.font, job->sdf_size, job->sdf_spread, &job->layout, &target);
+	} else if (job->channels == 4) {
+		succ = gtxt_ft_gen_char_to(job->key.unicode, job->key.line_x, &job->style, &job->layout, &target);
+	} else {
+		succ = gtxt_ft_gen_coverage_to(job->key.unicode, &job->style, &job->layout, job->channels, &target);
+	}
+	if (!succ) {
+		return;
+	}
+
+	// sized but nothing drawn
+	size_t sz = (size_t)job->layout.sizer.width * (size_t)job->layout.sizer.height * job->channels;
+	if (!job->pixels && sz > 0) {
+		job->pixels = calloc(1, sz);
+		if (!job->pixels) {
+			return;
+		}
+	}
+	job->done = true;
+}
+
+static GTXT_THREAD_FUNC(_prewarm_func, ud) {
+	struct prewarm* pw = (struct prewarm*)ud;
+
+	struct gtxt_ft_context* ctx = gtxt_ft_context_create();
+	if (!ctx) {
+		GTXT_THREAD_RETURN;
+	}
+	gtxt_ft_context_bind(ctx);
+
+	while (true) {
+		gtxt_mutex_lock(&pw->lock);
+		int idx = pw->next++;
+		gtxt_mutex_unlock(&pw->lock);
+		if (idx >= pw->count) {
+			break;
+		}
+		_job_raster(ctx, &pw->jobs[idx]);
+	}
+
+	gtxt_ft_context_bind(NULL);
+	gtxt_ft_context_release(ctx);
+
+	GTXT_THREAD_RETURN;
+}
+
+// returns false if the mode has changed or the font was invalidated meanwhile,
+// or if out of memory
+static bool
+_job_insert(struct raster_job* job, bool count_miss) {
+	const struct gtxt_glyph_style* style = &job->style;
+	if (job->channels != _get_channels(style)
+	 || job->font_gen != _font_gen(style->font)
+	 || (job->channels == 4 && job->premultiplied != gtxt_ft_is_premultiplied())
+	 || job->sdf_size != (_is_sdf(style) ? C->sdf_size : 0)
+	 || job->sdf_spread != (_is_sdf(style) ? C->sdf_spread : 0)) {
+		return false;
+	}
+
+	struct glyph_shard* s = _get_shard(job->hash);
+	_lock(&s->lock);
+
+	struct glyph* g = (struct glyph*)gtxt_hash_query(s->hash, job->hash, &job->key, _equal_func);
+	if (g) {
+		_touch_glyph(s, g);
+	} else {
+		g = _new_node(s);
+		if (!g || !_node_init(s, g, &job->key, job->hash)) {
+			_unlock(&s->lock);
+			return false;
+		}
+		g->layout = job->layout;
+	}
+
+	if (!_bind_bitmap(s, g)) {
+		_unlock(&s->lock);
+		return false;
+	}
+	if (!_bitmap_is_valid(s, g->bitmap)) {
+		if (count_miss) {
+			++_stat(s, g->stat)->bitmap.misses;
+		}
+		_count_raster(s, g);
+		g->layout = job->layout;
+		g->bitmap->channels = job->channels;
+		if (_is_sdf(style)) {
+			_bitmap_store(s, g->bitmap, job->pixels, (int)job->layout.sizer.width, (int)job->layout.sizer.height, job->channels);
+		} else {
+			_bitmap_store_cov(s, g->bitmap, (const uint8_t*)job->pixels, (int)job->layout.sizer.width, (int)job->layout.sizer.height, job->channels);
+		}
+	}
+	_touch_bitmap(s, g->bitmap);
+
+	_unlock(&s->lock);
+	return true;
+}
+
+struct glyph_async {
+	gtxt_mutex lock;
+	gtxt_cond cond;
+	bool quit;
+
+	// jobs are queued, drawn, then held as done until polled
+	struct raster_job *queue_head, *queue_tail;
+	struct raster_job* done;
+	// all of them, by key
+	struct gtxt_hash* pending;
+
+	void (*on_ready)(int unicode, float line_x, const struct gtxt_glyph_style* style, void* ud);
+	void* ud;
+
+	int thread_count;
+	gtxt_thread threads[1];
+};
+
+static GTXT_THREAD_FUNC(_async_func, ud) {
+	struct glyph_async* a = (struct glyph_async*)ud;
+
+	struct gtxt_ft_context* ctx = gtxt_ft_context_create();
+	if (!ctx) {
+		GTXT_THREAD_RETURN;
+	}
+	gtxt_ft_context_bind(ctx);
+
+	gtxt_mutex_lock(&a->lock);
+	while (true) {
+		while (!a->quit && !a->queue_head) {
+			gtxt_cond_wait(&a->cond, &a->lock);
+		}
+		if (a->quit) {
+			break;
+		}
+
+		struct raster_job* job = a->queue_head;
+		a->queue_head = job->next;
+		if (!a->queue_head) {
+			a->queue_tail = NULL;
+		}
+		gtxt_mutex_unlock(&a->lock);
+
+		_job_raster(ctx, job);
+
+		gtxt_mutex_lock(&a->lock);
+		job->next = a->done;
+		a->done = job;
+	}
+	gtxt_mutex_unlock(&a->lock);
+
+	gtxt_ft_context_bind(NULL);
+	gtxt_ft_context_release(ctx);
+
+	GTXT_THREAD_RETURN;
+}
+
+static inline void
+_free_jobs(struct raster_job* job) {
+	while (job) {
+		struct raster_job* next = job->next;
+		_style_release(job->key.style);
+		free(job->pixels);
+		free(job);
+		job = next;
+	}
+}
+
+// call with the shard locked, user fonts are drawn in place
+static bool
+_async_submit(const struct glyph_key* key, uint64_t hash, float line_x, const struct gtxt_glyph_style* style) {
+	struct glyph_async* a = C->async;
+	if (!a || style->font < 0 || style->font >= gtxt_ft_get_font_cout()) {
+		return false;
+	}
+
+	bool pending = true;
+	gtxt_mutex_lock(&a->lock);
+	if (!gtxt_hash_query(a->pending, hash, key, _job_equal_func)) {
+		struct raster_job* job = (struct raster_job*)malloc(sizeof(*job));
+		if (job) {
+			_job_init(job, key, hash, line_x, style);
+		}
+		if (job && gtxt_hash_insert(a->pending, hash, job)) {
+			if (a->queue_tail) {
+				a->queue_tail->next = job;
+			} else {
+				a->queue_head = job;
+			}
+			a->queue_tail = job;
+			gtxt_cond_signal(&a->cond);
+		} else {
+			_free_jobs(job);
+			pending = false;
+		}
+	}
+	gtxt_mutex_unlock(&a->lock);
+
+	return pending;
+}
+
+static bool
+_set_async(int thread_count,
+		   void (*on_ready)(int unicode, float line_x, const struct gtxt_glyph_style* style, void* ud), void* ud) {
+	_lock_all();
+	struct glyph_async* old = C->async;
+	C->async = NULL;
+	_unlock_all();
+
+	if (old) {
+		gtxt_mutex_lock(&old->lock);
+		old->quit = true;
+		gtxt_cond_broadcast(&old->cond);
+		gtxt_mutex_unlock(&old->lock);
+		for (int i = 0; i < old->thread_count; ++i) {
+			gtxt_thread_join(old->threads[i]);
+		}
+		// dropped, they are asked for again on the next miss
+		_free_jobs(old->queue_head);
+		_free_jobs(old->done);
+		gtxt_hash_release(old->pending);
+		gtxt_cond_release(&old->cond);
+		gtxt_mutex_release(&old->lock);
+		free(old);
+	}
+
+	if (thread_count <= 0) {
+		return true;
+	}
+
+	size_t sz = sizeof(struct glyph_async) + sizeof(gtxt_thread) * (thread_count - 1);
+	struct glyph_async* a = (struct glyph_async*)malloc(sz);
+	if (!a) {
+		return false;
+	}
+	memset(a, 0, sz);
+	a->pending = gtxt_hash_create(64);
+	if (!a->pending) {
+		free(a);
+		return false;
+	}
+	a->on_ready = on_ready;
+	a->ud = ud;
+	gtxt_mutex_init(&a->lock);
+	gtxt_cond_init(&a->cond);
+
+	for ( ; a->thread_count < thread_count; ++a->thread_count) {
+		if (!gtxt_thread_create(&a->threads[a->thread_count], _async_func, a)) {
+			break;
+		}
+	}
+	if (a->thread_count == 0) {
+		gtxt_hash_release(a->pending);
+		gtxt_cond_release(&a->cond);
+		gtxt_mutex_release(&a->lock);
+		free(a);
+		return false;
+	}
+
+	_lock_all();
+	C->async = a;
+	_unlock_all();
+
+	return true;
+}
+
+bool
+gtxt_glyph_enable_async(int thread_count,
+						void (*on_ready)(int unicode, float line_x, const struct gtxt_glyph_style* style, void* ud), void* ud) {
+	if (!C) {
+		return false;
+	}
+
+	gtxt_mutex_lock(&C->async_lock);
+	bool ret = _set_async(thread_count, on_ready, ud);
+	gtxt_mutex_unlock(&C->async_lock);
+
+	return ret;
+}
+
+static int
+_poll_async(struct glyph_async* a) {
+	gtxt_mutex_lock(&a->lock);
+	struct raster_job* done = a->done;
+	a->done = NULL;
+	for (struct raster_job* job = done; job; job = job->next) {
+		gtxt_hash_remove(a->pending, job->hash, job);
+	}
+	gtxt_mutex_unlock(&a->lock);
+
+	int count = 0;
+	for (struct raster_job* job = done; job; job = job->next) {
+		bool ready = false;
+		if (job->done) {
+			ready = _job_insert(job, false);
+		} else {
+			// glyphs the threads can't draw take the synchronous path,
+			// with its fallbacks
+			struct glyph_shard* s = _get_shard(job->hash);
+			_lock(&s->lock);
+			struct glyph* g = (struct glyph*)gtxt_hash_query(s->hash, job->hash, &job->key, _equal_func);
+			if (g && _bind_bitmap(s, g)) {
+				if (!_bitmap_is_valid(s, g->bitmap)) {
+					_gen(s, g, &job->style);
+				}
+				ready = g->bitmap->valid;
+			}
+			_unlock(&s->lock);
+		}
+		if (ready) {
+			++count;
+			if (a->on_ready) {
+				a->on_ready(job->key.unicode, job->line_x, &job->style, a->ud);
+			}
+		}
+	}
+	_free_jobs(done);
+
+	return count;
+}
+
+int
+gtxt_glyph_poll_async() {
+	if (!C) {
+		return 0;
+	}
+
+	// keeps enable_async from freeing the state under the callbacks
+	gtxt_mutex_lock(&C->async_lock);
+	int count = C->async ? _poll_async(C->async) : 0;
+	gtxt_mutex_unlock(&C->async_lock);
+
+	return count;
+}
+
+void
+gtxt_glyph_prefetch(int unicode, float line_x, const struct gtxt_glyph_style* style) {
+	if (!C) {
+		return;
+	}
+
+	struct glyph_key key;
+	if (!_make_key(&key, unicode, line_x, style)) {
+		return;
+	}
+	uint64_t hash = _hash_key(&key);
+	if (_is_cached(&key, hash, _get_channels(style))) {
+		return;
+	}
+
+	struct glyph_shard* s = _get_shard(hash);
+	_lock(&s->lock);
+	_async_submit(&key, hash, line_x, style);
+	_unlock(&s->lock);
+}
+
+void
+gtxt_glyph_prewarm(const int* unicodes, int unicode_count, const struct gtxt_glyph_style* styles, int style_count, int thread_count) {
+	if (!C || !unicodes || !styles || unicode_count <= 0 || style_count <= 0) {
+		return;
+	}
+	// the product is an int count, with room for the hash table over it
+	if (unicode_count > INT_MAX / 2 / style_count) {
+		return;
+	}
+	int cap = unicode_count * style_count;
+	if ((size_t)cap > SIZE_MAX / sizeof(struct raster_job)) {
+		return;
+	}
+	struct prewarm pw;
+	memset(&pw, 0, sizeof(pw));
+	pw.jobs = (struct raster_job*)malloc(sizeof(struct raster_job) * cap);
+	struct gtxt_hash* seen = gtxt_hash_create(cap);
+	if (!pw.jobs || !seen) {
+		free(pw.jobs);
+		gtxt_hash_release(seen);
+		return;
+	}
+
+	// dedupe and drop the cached ones, user fonts are left to the first draw
+	int ft_count = gtxt_ft_get_font_cout();
+	for (int i = 0; i < style_count; ++i) {
+		const struct gtxt_glyph_style* style = &styles[i];
+		if (style->font < 0 || style->font >= ft_count) {
+			continue;
+		}
+		for (int j = 0; j < unicode_count; ++j) {
+			struct glyph_key key;
+			if (!_make_key(&key, unicodes[j], 0, style)) {
+				continue;
+			}
+			uint64_t hash = _hash_key(&key);
+			if (gtxt_hash_query(seen, hash, &key, _job_equal_func)
+			 || _is_cached(&key, hash, _get_channels(style))) {
+				continue;
+			}
+			struct raster_job* job = &pw.jobs[pw.count++];
+			_job_init(job, &key, hash, 0, style);
+			// a duplicate at worst, inserted once
+			gtxt_hash_insert(seen, hash, job);
+		}
+	}
+	gtxt_hash_release(seen);
+
+	int n = MIN(thread_count, pw.count);
+	gtxt_thread* threads = n > 1 ? (gtxt_thread*)malloc(sizeof(gtxt_thread) * n) : NULL;
+	if (threads) {
+		gtxt_mutex_init(&pw.lock);
+		int created = 0;
+		for ( ; created < n; ++created) {
+			if (!gtxt_thread_create(&threads[created], _prewarm_func, &pw)) {
+				break;
+			}
+		}
+		for (int i = 0; i < created; ++i) {
+			gtxt_thread_join(threads[i]);
 		}
+		gtxt_mutex_release(&pw.lock);
+		free(threads);
+	}
+
+	// anything left, with the shared context
+	for (int i = 0; i < pw.count; ++i) {
+		struct raster_job* job = &pw.jobs[i];
+		if (!job->done) {
+			_lock(&C->ft_lock);
+			_job_raster(NULL, job);
+			_unlock(&C->ft_lock);
+		}
+		if (job->done) {
+			_job_insert(job, true);
+		}
+		free(job->pixels);
+		_style_release(job->key.style);
+	}
+
+	free(pw.jobs);
+}
 
-		memcpy(g->bitmap->buf, buf, sz);
-		g->bitmap->valid = true;
+void
+gtxt_glyph_prewarm_str(const char* str, const struct gtxt_glyph_style* styles, int style_count, int thread_count) {
+	if (!str) {
+		return;
+	}
+	size_t str_len = strlen(str);
+	if (str_len > INT_MAX) {
+		return;
+	}
+	int* unicodes = (int*)malloc(sizeof(int) * (str_len > 0 ? str_len : 1));
+	if (!unicodes) {
+		return;
+	}
 
-		ret_buf = g->bitmap->buf;
+	int count = 0;
+	for (size_t i = 0; i < str_len; ) {
+		int len = gtxt_unicode_len(str[i]);
+		// a sequence cut off by the end
+		if (len <= 0 || (size_t)len > str_len - i) {
+			break;
+		}
+		unicodes[count++] = gtxt_get_unicode(str + i, len);
+		i += len;
 	}
 
-	DS_FREELIST_MOVE_NODE_TO_TAIL(C->bmp_buf, g->bitmap);
-	return ret_buf;
+	gtxt_glyph_prewarm(unicodes, count, styles, style_count, thread_count);
+
+	free(unicodes);
 }
\ No newline at end of file
@@ -9,6 +9,7 @@ extern "C"
 #include "gtxt_typedef.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 
 struct gtxt_glyph_sizer {
 	float width;
@@ -54,15 +55,270 @@ struct gtxt_glyph_style {
 	struct gtxt_glyph_color edge_color;
 };
 
+struct gtxt_glyph_cache_stats {
+	uint64_t hits, misses, evictions;
+	// layout nodes, or bitmap pixels on the heap or in the atlas
+	size_t bytes;
+	// the part held by gtxt_glyph_pin()
+	int pinned;
+	size_t pinned_bytes;
+};
+
+struct gtxt_glyph_stats {
+	// -1 for the totals and for sizes beyond the tracked ones
+	int font, font_size;
+
+	struct gtxt_glyph_cache_stats layout, bitmap;
+	uint64_t raster_plain, raster_edge;
+	uint64_t disk_loads;
+	// taken back from the cold tier
+	uint64_t cold_loads;
+
+	// hash groups visited per lookup, totals only
+	float probe_avg;
+	int probe_max;
+};
+
+enum gtxt_glyph_format {
+	// straight alpha
+	GTXT_GLYPH_RGBA = 0,
+	GTXT_GLYPH_RGBA_PREMUL,
+	// alpha only, for tinting single color text
+	GTXT_GLYPH_A8,
+	// luminance and alpha
+	GTXT_GLYPH_LA8,
+};
+
+struct gtxt_glyph_output {
+	enum gtxt_glyph_format format;
+	// bytes per row, 0 for tightly packed
+	int stride;
+	// cached bitmaps are bottom-up
+	bool top_down;
+};
+
+static inline int
+gtxt_glyph_format_bpp(enum gtxt_glyph_format format) {
+	switch (format)
+	{
+	case GTXT_GLYPH_A8:
+		return 1;
+	case GTXT_GLYPH_LA8:
+		return 2;
+	default:
+		return 4;
+	}
+}
+
+enum gtxt_glyph_policy {
+	GTXT_GLYPH_LRU = 0,
+	// entries used again in a later frame are protected, eviction passes over
+	// them once, so a long run of one-off glyphs doesn't flush the hot ones
+	GTXT_GLYPH_SLRU,
+};
+
+struct gtxt_glyph_region {
+	// -1 for blank glyphs, such as spaces, the rest is 0
+	int page;
+	int x, y, w, h;
+	float u0, v0, u1, v1;
+};
+
+enum gtxt_glyph_change_type {
+	GTXT_GLYPH_CREATED = 0,
+	GTXT_GLYPH_EVICTED,
+	// the cache was dropped or the journal overflowed, re-check everything
+	GTXT_GLYPH_RESET,
+};
+
+struct gtxt_glyph_change {
+	enum gtxt_glyph_change_type type;
+	int unicode, font, font_size;
+	// heap bitmaps of created glyphs, valid until their eviction, NULL for
+	// span encoded ones
+	const void* pixels;
+	// atlas mode, -1 otherwise
+	int page, x, y;
+	int w, h, channels;
+	// bumped each time the bitmap is taken by another glyph
+	int version;
+};
+
 void gtxt_glyph_create(int cap_bitmap, int cap_layout,
 					   uint32_t* (*char_gen)(const char* str, const struct gtxt_glyph_style* style, struct gtxt_glyph_layout* layout),
 					   void (*get_uf_layout)(int unicode, int font, struct gtxt_glyph_layout* layout));
+// the cache is split into shards by key hash, each with its own lock, and
+// rasterization is serialized
+void gtxt_glyph_create_concurrent(int cap_bitmap, int cap_layout, int shard_count,
+								  uint32_t* (*char_gen)(const char* str, const struct gtxt_glyph_style* style, struct gtxt_glyph_layout* layout),
+								  void (*get_uf_layout)(int unicode, int font, struct gtxt_glyph_layout* layout));
 void gtxt_glyph_release();
+// drops the calling thread's last looked up style, job threads call it
+// before exit, as gtxt_layout_release()
+void gtxt_glyph_thread_release();
 
-struct gtxt_glyph_layout* gtxt_glyph_get_layout(int unicode, float line_x, const struct gtxt_glyph_style*);
+// new caps for the live cache, split between shards as on creation; entries
+// stay, the glyph table is moved over a few groups per lookup and lowered
+// caps are reached by evicting a few of the oldest entries per miss; node
+// storage is kept for growing again; false if out of memory
+bool gtxt_glyph_resize(int cap_bitmap, int cap_layout);
+
+// the font's glyphs are no longer found, drawn again when asked for and the
+// old ones left for eviction; also drops them from the disk and cold tiers
+// and from async rasters in flight; call after gtxt_ft_reload_font(), pins
+// of the old glyphs are dropped with them
+void gtxt_glyph_invalidate_font(int font);
 
+// the returned pointers are owned by the cache and may be recycled by other
+// threads in concurrent mode, use the query and copy versions there; cached
+// ones stay valid until gtxt_glyph_frame_end() in a frame scope; NULL or
+// false if out of memory, such as when a frame scope holds all of a shard
+struct gtxt_glyph_layout* gtxt_glyph_get_layout(int unicode, float line_x, const struct gtxt_glyph_style*);
 uint32_t* gtxt_glyph_get_bitmap(int unicode, float line_x, const struct gtxt_glyph_style*, struct gtxt_glyph_layout* layout);
 
+bool gtxt_glyph_query_layout(int unicode, float line_x, const struct gtxt_glyph_style*, struct gtxt_glyph_layout* layout);
+// returns the pixel count, dst is filled only if it fits in dst_cap
+int  gtxt_glyph_copy_bitmap(int unicode, float line_x, const struct gtxt_glyph_style*, struct gtxt_glyph_layout* layout, uint32_t* dst, int dst_cap);
+// converted to out, returns the bytes needed and fills dst only if they fit
+size_t gtxt_glyph_copy_bitmap_fmt(int unicode, float line_x, const struct gtxt_glyph_style*, const struct gtxt_glyph_output* out,
+								  struct gtxt_glyph_layout* layout, void* dst, size_t dst_sz);
+
+// of the cached RGBA bitmaps and atlas pages, GTXT_GLYPH_RGBA or
+// GTXT_GLYPH_RGBA_PREMUL, changing it drops them; an A8 cache is coverage mode
+bool gtxt_glyph_set_format(enum gtxt_glyph_format format);
+enum gtxt_glyph_format gtxt_glyph_get_format();
+
+// line_x only keys glyphs whose gradient has an angle, rounded down to a
+// multiple of step pixels, 0 for exact positions
+void gtxt_glyph_set_line_x_step(float step);
+
+// for animated scale, such as by richtext's dynamic=scale: scaled is the
+// style to draw the glyph with, at font_size times the power of two step at
+// or above scale, steps_per_octave of them up to 16 times either way, so a
+// few sizes serve the whole animation; the returned factor is what the
+// glyph's layout and bitmap are scaled by when drawn. With 0 steps, the
+// default, the style is kept and scale returned; in sdf mode the size is
+// exact as the field serves them all
+void  gtxt_glyph_set_scale_steps(int steps_per_octave);
+float gtxt_glyph_scale_style(const struct gtxt_glyph_style* style, float scale, struct gtxt_glyph_style* scaled);
+
+// of both layouts and bitmaps, frames are counted by gtxt_glyph_begin_frame()
+void gtxt_glyph_set_policy(enum gtxt_glyph_policy policy);
+
+// keeps the glyphs of unicodes in style and their bitmaps cached, drawing
+// the missing ones now, until unpinned as many times; they count against the
+// bitmap budget, and at most half of each shard's entries can be pinned;
+// returns the count pinned
+int  gtxt_glyph_pin(const int* unicodes, int count, const struct gtxt_glyph_style* style);
+void gtxt_glyph_unpin(const int* unicodes, int count, const struct gtxt_glyph_style* style);
+
+// records bitmaps created and evicted in order, a reused bitmap is evicted
+// then created; off by default
+void gtxt_glyph_enable_journal(bool enable);
+// moves up to cap of the oldest changes out, returns the count
+int  gtxt_glyph_drain_changes(struct gtxt_glyph_change* changes, int cap);
+
+// caps the synchronous rasterizations between gtxt_glyph_begin_frame()
+// calls by count and by microseconds, 0 for no limit; misses over budget
+// come back empty with the layout filled, as not ready, and are drawn when
+// asked for again in a later frame
+void gtxt_glyph_set_frame_budget(int max_rasters, int max_us);
+// returns the misses deferred since the last call
+int  gtxt_glyph_begin_frame();
+
+// a frame scope, entries used until gtxt_glyph_frame_end() are not evicted,
+// the shards holding more than their caps grow and are evicted down after;
+// begin counts a frame as gtxt_glyph_begin_frame() does, and returns the
+// same; atlas pages with regions held are not recycled until it ends, so
+// misses may fail when all pages are held or pinned
+int  gtxt_glyph_frame_begin();
+void gtxt_glyph_frame_end();
+
+// versioned references to cached glyphs, stale once the glyph is evicted
+typedef uint64_t gtxt_glyph_handle;
+#define GTXT_GLYPH_HANDLE_NONE 0
+
+// looked up and drawn as by gtxt_glyph_get_bitmap()
+gtxt_glyph_handle gtxt_glyph_acquire(int unicode, float line_x, const struct gtxt_glyph_style*);
+// false if stale, copies the layout as cached, of the field at ref_size in
+// sdf mode
+bool gtxt_glyph_handle_layout(gtxt_glyph_handle, struct gtxt_glyph_layout* layout);
+// the cached pixels, RGBA, coverage or the distance field by mode, NULL if
+// stale, not drawn yet, in the atlas or span encoded
+const void* gtxt_glyph_handle_pixels(gtxt_glyph_handle, int* channels);
+
+// hard limit on the heap bytes held by cached bitmaps, split evenly between
+// shards, 0 for no limit; counted as the slabs they are carved from, free
+// blocks included, so a shard's share takes at least a slab of 16KB;
+// glyphs larger than it are not cached
+void   gtxt_glyph_set_bitmap_budget(size_t bytes);
+size_t gtxt_glyph_get_bitmap_budget();
+size_t gtxt_glyph_get_bitmap_bytes();
+// bitmaps are kept in size classed slabs, frees the ones left empty, such as
+// after a burst of large glyphs; returns the bytes reclaimed
+size_t gtxt_glyph_trim();
+
+// cold tier, evicted bitmaps are kept compressed under their own budget,
+// split evenly between shards, and misses take them back before drawing;
+// dropped with the cache, 0 for off
+void   gtxt_glyph_set_cold_budget(size_t bytes);
+size_t gtxt_glyph_get_cold_bytes();
+
+void gtxt_glyph_get_stats(struct gtxt_glyph_stats* stats);
+// per font and size, returns the count filled
+int  gtxt_glyph_get_font_stats(struct gtxt_glyph_stats* stats, int cap);
+void gtxt_glyph_reset_stats();
+
+// rasterizes the missing glyphs of every unicode and style pair on up to
+// thread_count threads, only inserting into the cache is serialized; does
+// nothing if the pairs don't fit in an int
+void gtxt_glyph_prewarm(const int* unicodes, int unicode_count, const struct gtxt_glyph_style* styles, int style_count, int thread_count);
+void gtxt_glyph_prewarm_str(const char* str, const struct gtxt_glyph_style* styles, int style_count, int thread_count);
+
+// async mode, misses of freetype glyphs are drawn on thread_count threads
+// and come back empty, with the layout filled; gtxt_glyph_poll_async()
+// inserts the finished ones on the calling thread and calls on_ready for
+// each, with the line_x it was asked for, returning the count; 0 threads
+// turns it off; on_ready must not enable, disable or poll async itself
+bool gtxt_glyph_enable_async(int thread_count,
+							 void (*on_ready)(int unicode, float line_x, const struct gtxt_glyph_style* style, void* ud), void* ud);
+int  gtxt_glyph_poll_async();
+// queues the glyph if it isn't cached, async mode only
+void gtxt_glyph_prefetch(int unicode, float line_x, const struct gtxt_glyph_style*);
+
+// warm start cache file, mapped read-only and served from directly, glyphs
+// of fonts whose file has changed are ignored; saving keeps the loaded
+// glyphs that were not used
+bool gtxt_glyph_load_cache(const char* filepath);
+bool gtxt_glyph_save_cache(const char* filepath);
+
+// atlas mode, glyphs are packed into pages and gtxt_glyph_get_bitmap() returns NULL
+void gtxt_glyph_enable_atlas(int page_width, int page_height, int max_pages);
+// false if not drawn, such as when out of memory or deferred
+bool gtxt_glyph_get_region(int unicode, float line_x, const struct gtxt_glyph_style*, struct gtxt_glyph_layout* layout, struct gtxt_glyph_region* region);
+int  gtxt_glyph_get_atlas_page_count();
+// RGBA pixels, or interleaved fill and edge coverage in coverage mode
+const void* gtxt_glyph_get_atlas_page(int page, int* width, int* height, bool* dirty);
+
+// coverage mode, glyphs are cached by font, size and edge size only, and
+// gtxt_glyph_get_bitmap() colorizes into a buffer valid until the next call
+void gtxt_glyph_enable_coverage(bool enable);
+const uint8_t* gtxt_glyph_get_coverage(int unicode, const struct gtxt_glyph_style*, struct gtxt_glyph_layout* layout, int* channels);
+// heap coverage is kept as runs of each channel, which shrinks large and
+// sparse glyphs, and is expanded when emitted; gtxt_glyph_get_coverage()
+// then returns a buffer valid until the next call; off by default; false
+// unless in coverage mode without the atlas, and leaving that mode later
+// stops encoding new glyphs
+bool gtxt_glyph_enable_spans(bool enable);
+
+// sdf mode, freetype glyphs are cached as one distance field per font and
+// unicode at ref_size, padded by spread pixels; layouts are scaled to the
+// style's size, and edges are drawn by threshold; 0 turns it off
+void gtxt_glyph_enable_sdf(int ref_size, int spread);
+// the field, 128 on the outline and rising inwards, layout is of the padded
+// field at ref_size; atlas regions in sdf mode hold the field the same way
+const uint8_t* gtxt_glyph_get_sdf(int unicode, const struct gtxt_glyph_style*, struct gtxt_glyph_layout* layout);
+
 #endif // gametext_glyph_h
 
 #ifdef __cplusplus
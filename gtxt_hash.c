@@ -0,0 +1,398 @@
+#include "gtxt_hash.h"
+#include "gtxt_typedef.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define GROUP_WIDTH 8
+
+#define CTRL_EMPTY		0x80
+#define CTRL_DELETED	0xfe
+
+#define LSBS 0x0101010101010101ULL
+#define MSBS 0x8080808080808080ULL
+
+struct slot {
+	uint64_t hash;
+	void* val;
+};
+
+// groups moved from the old table by each query, insert and remove
+#define MOVE_GROUPS 2
+
+struct table {
+	uint8_t* ctrl;
+	struct slot* slots;
+
+	size_t group_mask;
+	size_t cap;
+
+	int size;
+	int growth_left;
+};
+
+struct gtxt_hash {
+	struct table t;
+
+	// being moved into t from its first group on, gone once empty
+	struct table old;
+	size_t move_group;
+
+	struct gtxt_hash_stats stats;
+};
+
+static inline int
+_ctz64(uint64_t v) {
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanForward64(&idx, v);
+	return (int)idx;
+#else
+	return __builtin_ctzll(v);
+#endif
+}
+
+static inline uint64_t
+_load_group(const uint8_t* ctrl) {
+	uint64_t v;
+	memcpy(&v, ctrl, sizeof(v));
+#ifdef GTXT_BIG_ENDIAN
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+// may report false positives, slots are verified by ctrl and the full hash
+static inline uint64_t
+_match_byte(uint64_t group, uint8_t b) {
+	uint64_t x = group ^ (LSBS * b);
+	return (x - LSBS) & ~x & MSBS;
+}
+
+static inline uint64_t
+_match_empty(uint64_t group) {
+	return group & ~(group << 6) & MSBS;
+}
+
+static inline uint64_t
+_match_empty_or_deleted(uint64_t group) {
+	return group & MSBS;
+}
+
+static inline size_t
+_h1(uint64_t hash) {
+	return (size_t)(hash >> 7);
+}
+
+static inline uint8_t
+_h2(uint64_t hash) {
+	return (uint8_t)(hash & 0x7f);
+}
+
+static inline int
+_max_load(size_t cap) {
+	return (int)(cap - cap / 8);
+}
+
+static bool
+_alloc(struct table* h, size_t cap) {
+	uint8_t* ctrl = (uint8_t*)malloc(cap);
+	struct slot* slots = (struct slot*)malloc(sizeof(struct slot) * cap);
+	if (!ctrl || !slots) {
+		free(ctrl);
+		free(slots);
+		return false;
+	}
+	memset(ctrl, CTRL_EMPTY, cap);
+
+	h->ctrl = ctrl;
+	h->slots = slots;
+	h->cap = cap;
+	h->group_mask = cap / GROUP_WIDTH - 1;
+	h->size = 0;
+	h->growth_left = _max_load(cap);
+	return true;
+}
+
+static inline void
+_free(struct table* h) {
+	free(h->ctrl);
+	free(h->slots);
+	memset(h, 0, sizeof(*h));
+}
+
+static inline size_t
+_find_free(struct table* h, uint64_t hash) {
+	size_t g = _h1(hash) & h->group_mask;
+	for (size_t probe = 0; ; ) {
+		uint64_t m = _match_empty_or_deleted(_load_group(&h->ctrl[g * GROUP_WIDTH]));
+		if (m) {
+			return g * GROUP_WIDTH + _ctz64(m) / 8;
+		}
+		++probe;
+		assert(probe <= h->group_mask);
+		g = (g + probe) & h->group_mask;
+	}
+}
+
+static inline void
+_set_slot(struct table* h, size_t idx, uint64_t hash, void* val) {
+	if (h->ctrl[idx] == CTRL_EMPTY) {
+		--h->growth_left;
+	}
+	h->ctrl[idx] = _h2(hash);
+	h->slots[idx].hash = hash;
+	h->slots[idx].val = val;
+	++h->size;
+}
+
+static inline size_t
+_table_size(int cap) {
+	size_t sz = GROUP_WIDTH;
+	while (_max_load(sz) < cap) {
+		sz *= 2;
+	}
+	return sz;
+}
+
+static inline bool
+_is_moving(const struct gtxt_hash* h) {
+	return h->old.ctrl != NULL;
+}
+
+// up to groups groups of the old table into the new one, stops early if
+// the new one is full, the next insert makes room
+static void
+_move(struct gtxt_hash* h, size_t groups) {
+	struct table* old = &h->old;
+	size_t group_count = old->group_mask + 1;
+	for ( ; groups > 0 && h->move_group < group_count; --groups, ++h->move_group) {
+		size_t begin = h->move_group * GROUP_WIDTH;
+		for (size_t i = begin; i < begin + GROUP_WIDTH; ++i) {
+			if ((old->ctrl[i] & 0x80) != 0) {
+				continue;
+			}
+			if (h->t.growth_left == 0) {
+				return;
+			}
+			struct slot* s = &old->slots[i];
+			_set_slot(&h->t, _find_free(&h->t, s->hash), s->hash, s->val);
+			old->ctrl[i] = CTRL_DELETED;
+			--old->size;
+		}
+	}
+	if (h->move_group == group_count) {
+		assert(old->size == 0);
+		_free(old);
+		h->move_group = 0;
+	}
+}
+
+// the current table becomes the old one, moved over by later calls; what
+// is left of a move in progress goes to the new table at once
+static bool
+_start_move(struct gtxt_hash* h, size_t cap) {
+	struct table t;
+	if (!_alloc(&t, cap)) {
+		return false;
+	}
+	if (_is_moving(h)) {
+		struct table* old = &h->old;
+		for (size_t i = 0; i < old->cap; ++i) {
+			if ((old->ctrl[i] & 0x80) == 0) {
+				struct slot* s = &old->slots[i];
+				_set_slot(&t, _find_free(&t, s->hash), s->hash, s->val);
+			}
+		}
+		_free(old);
+	}
+
+	h->old = h->t;
+	h->t = t;
+	h->move_group = 0;
+	if (h->old.size == 0) {
+		_free(&h->old);
+	}
+	return true;
+}
+
+struct gtxt_hash*
+gtxt_hash_create(int cap) {
+	struct gtxt_hash* h = (struct gtxt_hash*)malloc(sizeof(*h));
+	if (!h) {
+		return NULL;
+	}
+	memset(h, 0, sizeof(*h));
+	if (!_alloc(&h->t, _table_size(cap))) {
+		free(h);
+		return NULL;
+	}
+	return h;
+}
+
+void
+gtxt_hash_release(struct gtxt_hash* h) {
+	if (!h) {
+		return;
+	}
+	_free(&h->t);
+	_free(&h->old);
+	free(h);
+}
+
+void
+gtxt_hash_clear(struct gtxt_hash* h) {
+	struct table* t = &h->t;
+	memset(t->ctrl, CTRL_EMPTY, t->cap);
+	t->size = 0;
+	t->growth_left = _max_load(t->cap);
+	_free(&h->old);
+	h->move_group = 0;
+}
+
+void
+gtxt_hash_reserve(struct gtxt_hash* h, int cap) {
+	size_t sz = _table_size(MAX(cap, gtxt_hash_size(h)));
+	if (sz != h->t.cap) {
+		_start_move(h, sz);
+	}
+}
+
+bool
+gtxt_hash_move(struct gtxt_hash* h, int groups) {
+	if (_is_moving(h) && groups > 0) {
+		_move(h, (size_t)groups);
+	}
+	return !_is_moving(h);
+}
+
+static inline void
+_record_probe(struct gtxt_hash* h, size_t groups) {
+	int n = (int)groups;
+	++h->stats.lookups;
+	h->stats.probes += n;
+	if (n > h->stats.max_probe) {
+		h->stats.max_probe = n;
+	}
+}
+
+// the groups visited are added to groups
+static void*
+_query(struct table* h, uint64_t hash, const void* key, bool (*equal)(const void* key, const void* val), size_t* groups) {
+	uint8_t h2 = _h2(hash);
+	size_t g = _h1(hash) & h->group_mask;
+	size_t i = 0;
+	for ( ; i <= h->group_mask; ) {
+		uint64_t group = _load_group(&h->ctrl[g * GROUP_WIDTH]);
+		uint64_t m = _match_byte(group, h2);
+		while (m) {
+			size_t idx = g * GROUP_WIDTH + _ctz64(m) / 8;
+			struct slot* s = &h->slots[idx];
+			if (h->ctrl[idx] == h2 && s->hash == hash && equal(key, s->val)) {
+				*groups += i + 1;
+				return s->val;
+			}
+			m &= m - 1;
+		}
+		if (_match_empty(group)) {
+			break;
+		}
+		++i;
+		g = (g + i) & h->group_mask;
+	}
+	*groups += i + 1;
+	return NULL;
+}
+
+void*
+gtxt_hash_query(struct gtxt_hash* h, uint64_t hash, const void* key, bool (*equal)(const void* key, const void* val)) {
+	if (_is_moving(h)) {
+		_move(h, MOVE_GROUPS);
+	}
+
+	size_t groups = 0;
+	void* val = _query(&h->t, hash, key, equal, &groups);
+	if (!val && _is_moving(h)) {
+		val = _query(&h->old, hash, key, equal, &groups);
+	}
+	_record_probe(h, groups);
+	return val;
+}
+
+bool
+gtxt_hash_insert(struct gtxt_hash* h, uint64_t hash, void* val) {
+	if (_is_moving(h)) {
+		_move(h, MOVE_GROUPS);
+	}
+
+	struct table* t = &h->t;
+	if (t->growth_left == 0) {
+		// drop tombstones if they are the most, or grow
+		int size = gtxt_hash_size(h);
+		size_t cap = size < _max_load(t->cap) / 2 ? t->cap : MAX(t->cap * 2, _table_size(size * 2));
+		if (!_start_move(h, cap)) {
+			return false;
+		}
+	}
+	_set_slot(t, _find_free(t, hash), hash, val);
+	return true;
+}
+
+static bool
+_remove(struct table* h, uint64_t hash, const void* val) {
+	uint8_t h2 = _h2(hash);
+	size_t g = _h1(hash) & h->group_mask;
+	for (size_t probe = 0; probe <= h->group_mask; ) {
+		uint64_t group = _load_group(&h->ctrl[g * GROUP_WIDTH]);
+		uint64_t m = _match_byte(group, h2);
+		while (m) {
+			size_t idx = g * GROUP_WIDTH + _ctz64(m) / 8;
+			if (h->ctrl[idx] == h2 && h->slots[idx].val == val) {
+				// probing stops at this group anyway if it has an empty slot
+				if (_match_empty(group)) {
+					h->ctrl[idx] = CTRL_EMPTY;
+					++h->growth_left;
+				} else {
+					h->ctrl[idx] = CTRL_DELETED;
+				}
+				--h->size;
+				return true;
+			}
+			m &= m - 1;
+		}
+		if (_match_empty(group)) {
+			return false;
+		}
+		++probe;
+		g = (g + probe) & h->group_mask;
+	}
+	return false;
+}
+
+bool
+gtxt_hash_remove(struct gtxt_hash* h, uint64_t hash, const void* val) {
+	if (_is_moving(h)) {
+		_move(h, MOVE_GROUPS);
+	}
+	return _remove(&h->t, hash, val)
+		|| (_is_moving(h) && _remove(&h->old, hash, val));
+}
+
+int
+gtxt_hash_size(struct gtxt_hash* h) {
+	return h->t.size + h->old.size;
+}
+
+void
+gtxt_hash_get_stats(struct gtxt_hash* h, struct gtxt_hash_stats* stats) {
+	*stats = h->stats;
+}
+
+void
+gtxt_hash_reset_stats(struct gtxt_hash* h) {
+	memset(&h->stats, 0, sizeof(h->stats));
+}
\ No newline at end of file
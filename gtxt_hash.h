@@ -0,0 +1,69 @@
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifndef gametext_hash_h
+#define gametext_hash_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// open addressing table probed by groups of 8 control bytes, the slots only
+// hold the 64-bit hash and the value, keys live in the values
+
+struct gtxt_hash;
+
+// probe lengths are counted in groups visited by gtxt_hash_query()
+struct gtxt_hash_stats {
+	uint64_t lookups;
+	uint64_t probes;
+	int max_probe;
+};
+
+struct gtxt_hash* gtxt_hash_create(int cap);
+void gtxt_hash_release(struct gtxt_hash*);
+
+void gtxt_hash_clear(struct gtxt_hash*);
+
+void* gtxt_hash_query(struct gtxt_hash*, uint64_t hash, const void* key, bool (*equal)(const void* key, const void* val));
+// false if the table is full and can't grow, val is not added
+bool  gtxt_hash_insert(struct gtxt_hash*, uint64_t hash, void* val);
+bool  gtxt_hash_remove(struct gtxt_hash*, uint64_t hash, const void* val);
+
+int gtxt_hash_size(struct gtxt_hash*);
+
+// tables are replaced incrementally, entries move a few groups per query,
+// insert and remove, and lookups check the old table until it is empty;
+// growing when full starts such a move too
+
+// to a table sized for cap, or for the current size if larger
+void gtxt_hash_reserve(struct gtxt_hash*, int cap);
+// up to groups groups more, returns true once nothing is left to move
+bool gtxt_hash_move(struct gtxt_hash*, int groups);
+
+void gtxt_hash_get_stats(struct gtxt_hash*, struct gtxt_hash_stats* stats);
+void gtxt_hash_reset_stats(struct gtxt_hash*);
+
+static inline uint64_t
+gtxt_hash_mix(uint64_t h, uint64_t v) {
+	h += v * 0xC2B2AE3D27D4EB4FULL;
+	h = (h << 31) | (h >> 33);
+	return h * 0x9E3779B185EBCA87ULL;
+}
+
+static inline uint64_t
+gtxt_hash_finish(uint64_t h) {
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+#endif // gametext_hash_h
+
+#ifdef __cplusplus
+}
+#endif
\ No newline at end of file
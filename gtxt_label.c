@@ -3,16 +3,25 @@
 #include "gtxt_richtext.h"
 #include "gtxt_glyph.h"
 #include "gtxt_util.h"
+#include "gtxt_thread.h"
 
 #include <ds_array.h>
 
 #include <string.h>
 #include <assert.h>
 
-static struct ds_array* UNICODE_BUF;
+static GTXT_THREAD_LOCAL struct ds_array* UNICODE_BUF;
 
 void (*DRAW_GLYPH)(int unicode, float x, float y, float w, float h, float start_x, const struct gtxt_glyph_style* gs, const struct gtxt_draw_style* ds, void* ud);
 
+void
+gtxt_label_release() {
+	if (UNICODE_BUF) {
+		ds_array_release(UNICODE_BUF);
+		UNICODE_BUF = NULL;
+	}
+}
+
 void
 gtxt_label_cb_init(void (*draw_glyph)(int unicode, float x, float y, float w, float h, float start_x, const struct gtxt_glyph_style* gs, const struct gtxt_draw_style* ds, void* ud)) {
 	DRAW_GLYPH = draw_glyph;
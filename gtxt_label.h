@@ -51,6 +51,10 @@ struct gtxt_label_style {
 struct gtxt_draw_style;
 struct gtxt_glyph_style;
 
+// frees the calling thread's buffer, job threads call it before exit, as
+// gtxt_layout_release()
+void gtxt_label_release();
+
 void gtxt_label_cb_init(void (*draw_glyph)(int unicode, float x, float y, float w, float h, float start_x, const struct gtxt_glyph_style* gs, const struct gtxt_draw_style* ds, void* ud));
 
 void gtxt_label_draw(const char* str, const struct gtxt_label_style* style, void* ud);
@@ -2,6 +2,7 @@
 #include "gtxt_glyph.h"
 #include "gtxt_label.h"
 #include "gtxt_richtext.h"
+#include "gtxt_thread.h"
 
 #include <ds_array.h>
 
@@ -21,6 +22,7 @@
 #define MAX_ROW_CONDENSE 0.10f
 
 static bool ENABLE_HORI_OFFSET = true;
+static bool ENABLE_PREFETCH = false;
 
 struct glyph {
 	int unicode;
@@ -76,7 +78,8 @@ struct layout {
 	struct row* curr_row;
 };
 
-static struct layout L;
+// one per thread, so labels can be laid out on job threads
+static GTXT_THREAD_LOCAL struct layout L;
 
 void
 gtxt_layout_release() {
@@ -455,8 +458,11 @@ _row_backtracking(struct row* row, float remain) {
 
 static enum GLO_STATUS
 _add_connected_sym(struct gtxt_richtext_style* style, const struct gtxt_glyph_style* gs) {
-	struct gtxt_glyph_layout* layout = gtxt_glyph_get_layout(CONNECT_UNICODE, 0, gs);
-	float conn_w = layout->advance * L.style->space_h;
+	struct gtxt_glyph_layout layout;
+	if (!gtxt_glyph_query_layout(CONNECT_UNICODE, 0, gs, &layout)) {
+		return GLOS_FULL;
+	}
+	float conn_w = layout.advance * L.style->space_h;
 	if (conn_w > L.style->width) {
 		return GLOS_FULL;
 	}
@@ -588,10 +594,14 @@ gtxt_layout_single(int unicode, float line_x, struct gtxt_richtext_style* style)
 	} else {
 		gs = &L.style->gs;
 	}
-	struct gtxt_glyph_layout* g_layout = gtxt_glyph_get_layout(unicode, line_x, gs);
-	if (!g_layout) {
+	struct gtxt_glyph_layout layout;
+	if (!gtxt_glyph_query_layout(unicode, line_x, gs, &layout)) {
 		return GLOS_NORMAL;
 	}
+	if (ENABLE_PREFETCH) {
+		gtxt_glyph_prefetch(unicode, line_x, gs);
+	}
+	struct gtxt_glyph_layout* g_layout = &layout;
 	float w = g_layout->advance * L.style->space_h;
 	enum GLO_STATUS status = _handle_new_line(unicode, line_x, style, gs, g_layout, w);
 	if (status == GLOS_NEWLINE || status == GLOS_FULL) {
@@ -673,8 +683,11 @@ _row_make_room(struct row* row, float remain) {
 
 int
 gtxt_layout_add_omit_sym(const struct gtxt_glyph_style* gs) {
-	struct gtxt_glyph_layout* layout = gtxt_glyph_get_layout(OMIT_UNICODE, 0, gs);
-	float omit_w = layout->advance * L.style->space_h * OMIT_COUNT;
+	struct gtxt_glyph_layout layout;
+	if (!gtxt_glyph_query_layout(OMIT_UNICODE, 0, gs, &layout)) {
+		return 0;
+	}
+	float omit_w = layout.advance * L.style->space_h * OMIT_COUNT;
 	if (omit_w > L.style->width) {
 		return 0;
 	}
@@ -884,4 +897,9 @@ gtxt_get_layout_size(float* width, float* height) {
 void
 gtxt_layout_enable_hori_offset(bool enable) {
 	ENABLE_HORI_OFFSET = enable;
-}
\ No newline at end of file
+}
+
+void
+gtxt_layout_enable_prefetch(bool enable) {
+	ENABLE_PREFETCH = enable;
+}
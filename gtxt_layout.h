@@ -21,6 +21,7 @@ enum GLO_STATUS
 	GLOS_CONNECTION
 };
 
+// frees the calling thread's buffers, job threads call it before exit
 void gtxt_layout_release();
 
 void gtxt_layout_begin(const struct gtxt_label_style* style);
@@ -39,6 +40,8 @@ void gtxt_layout_end();
 void gtxt_get_layout_size(float* width, float* height);
 
 void gtxt_layout_enable_hori_offset(bool enable);
+// queues bitmaps of laid out glyphs in glyph async mode
+void gtxt_layout_enable_prefetch(bool enable);
 
 #endif // gametext_layout_h
 
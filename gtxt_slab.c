@@ -0,0 +1,282 @@
+#include "gtxt_slab.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#define MIN_BLOCK_LOG 6
+#define MAX_BLOCK_LOG 16
+#define MIN_BLOCK ((size_t)1 << MIN_BLOCK_LOG)
+#define MAX_BLOCK ((size_t)1 << MAX_BLOCK_LOG)
+
+// the minimum, then 4 per octave
+#define CLASS_COUNT ((MAX_BLOCK_LOG - MIN_BLOCK_LOG) * 4 + 1)
+
+// small enough that the free blocks of all classes stay a few hundred KB
+#define SLAB_SIZE (16 * 1024)
+// keeps blocks 16-byte aligned
+#define SLAB_HEADER ((sizeof(struct slab) + 15) & ~(size_t)15)
+
+struct slab {
+	struct slab* next;
+	int blocks;
+	int used;
+};
+
+struct free_block {
+	struct free_block* next;
+};
+
+struct size_class {
+	size_t block;
+	struct slab* slabs;
+	struct free_block* free;
+};
+
+struct gtxt_slab {
+	struct size_class classes[CLASS_COUNT];
+	size_t bytes;
+	// with no block in use, what gtxt_slab_trim() can free
+	int empty;
+};
+
+static size_t
+_class_block(int idx) {
+	if (idx == 0) {
+		return MIN_BLOCK;
+	}
+	size_t base = (size_t)1 << ((idx - 1) / 4 + MIN_BLOCK_LOG);
+	return base + ((idx - 1) % 4 + 1) * (base / 4);
+}
+
+struct gtxt_slab*
+gtxt_slab_create() {
+	struct gtxt_slab* sl = (struct gtxt_slab*)malloc(sizeof(*sl));
+	if (!sl) {
+		return NULL;
+	}
+	memset(sl, 0, sizeof(*sl));
+	for (int i = 0; i < CLASS_COUNT; ++i) {
+		sl->classes[i].block = _class_block(i);
+	}
+	return sl;
+}
+
+void
+gtxt_slab_release(struct gtxt_slab* sl) {
+	if (!sl) {
+		return;
+	}
+	for (int i = 0; i < CLASS_COUNT; ++i) {
+		struct slab* slab = sl->classes[i].slabs;
+		while (slab) {
+			struct slab* next = slab->next;
+			free(slab);
+			slab = next;
+		}
+	}
+	free(sl);
+}
+
+static inline int
+_floor_log2(size_t v) {
+	int n = 0;
+	while (v >>= 1) {
+		++n;
+	}
+	return n;
+}
+
+// -1 past the largest class
+static inline int
+_class_of(size_t sz, size_t* block) {
+	if (sz <= MIN_BLOCK) {
+		*block = MIN_BLOCK;
+		return 0;
+	}
+	if (sz > MAX_BLOCK) {
+		*block = sz;
+		return -1;
+	}
+	// exact powers of two close the octave below
+	int octave = _floor_log2(sz - 1);
+	size_t base = (size_t)1 << octave;
+	size_t step = base / 4;
+	size_t sub = (sz - 1 - base) / step;
+	*block = base + (sub + 1) * step;
+	return (octave - MIN_BLOCK_LOG) * 4 + (int)sub + 1;
+}
+
+size_t
+gtxt_slab_block_size(size_t sz) {
+	if (sz == 0) {
+		return 0;
+	}
+	size_t block;
+	_class_of(sz, &block);
+	return block;
+}
+
+static inline uint8_t*
+_slab_blocks(struct slab* slab) {
+	return (uint8_t*)slab + SLAB_HEADER;
+}
+
+static inline struct slab*
+_find_slab(struct size_class* c, const void* ptr) {
+	for (struct slab* slab = c->slabs; slab; slab = slab->next) {
+		const uint8_t* begin = _slab_blocks(slab);
+		if ((const uint8_t*)ptr >= begin && (const uint8_t*)ptr < begin + c->block * slab->blocks) {
+			return slab;
+		}
+	}
+	return NULL;
+}
+
+static bool
+_add_slab(struct gtxt_slab* sl, struct size_class* c) {
+	size_t block = c->block;
+	int blocks = block < SLAB_SIZE ? (int)(SLAB_SIZE / block) : 1;
+	size_t sz = SLAB_HEADER + block * blocks;
+	struct slab* slab = (struct slab*)malloc(sz);
+	if (!slab) {
+		return false;
+	}
+	slab->blocks = blocks;
+	slab->used = 0;
+	slab->next = c->slabs;
+	c->slabs = slab;
+	sl->bytes += sz;
+	++sl->empty;
+
+	uint8_t* ptr = _slab_blocks(slab);
+	for (int i = blocks - 1; i >= 0; --i) {
+		struct free_block* b = (struct free_block*)(ptr + block * i);
+		b->next = c->free;
+		c->free = b;
+	}
+	return true;
+}
+
+void*
+gtxt_slab_alloc(struct gtxt_slab* sl, size_t sz) {
+	if (sz == 0) {
+		return NULL;
+	}
+
+	size_t block;
+	int idx = _class_of(sz, &block);
+	if (idx < 0) {
+		void* ptr = malloc(sz);
+		if (ptr) {
+			sl->bytes += sz;
+		}
+		return ptr;
+	}
+
+	struct size_class* c = &sl->classes[idx];
+	if (!c->free && !_add_slab(sl, c)) {
+		return NULL;
+	}
+	struct free_block* b = c->free;
+	c->free = b->next;
+	struct slab* slab = _find_slab(c, b);
+	assert(slab);
+	if (slab->used++ == 0) {
+		--sl->empty;
+	}
+	return b;
+}
+
+size_t
+gtxt_slab_alloc_bytes(struct gtxt_slab* sl, size_t sz) {
+	if (sz == 0) {
+		return 0;
+	}
+
+	size_t block;
+	int idx = _class_of(sz, &block);
+	if (idx < 0) {
+		return sz;
+	}
+	const struct size_class* c = &sl->classes[idx];
+	if (c->free) {
+		return 0;
+	}
+	int blocks = block < SLAB_SIZE ? (int)(SLAB_SIZE / block) : 1;
+	return SLAB_HEADER + block * blocks;
+}
+
+void
+gtxt_slab_free(struct gtxt_slab* sl, void* ptr, size_t sz) {
+	if (!ptr) {
+		return;
+	}
+
+	size_t block;
+	int idx = _class_of(sz, &block);
+	if (idx < 0) {
+		assert(sl->bytes >= sz);
+		sl->bytes -= sz;
+		free(ptr);
+		return;
+	}
+
+	struct size_class* c = &sl->classes[idx];
+	struct slab* slab = _find_slab(c, ptr);
+	assert(slab && slab->used > 0);
+	if (--slab->used == 0) {
+		++sl->empty;
+	}
+	struct free_block* b = (struct free_block*)ptr;
+	b->next = c->free;
+	c->free = b;
+}
+
+size_t
+gtxt_slab_trim(struct gtxt_slab* sl) {
+	size_t reclaimed = 0;
+	for (int i = 0; i < CLASS_COUNT && sl->empty > 0; ++i) {
+		struct size_class* c = &sl->classes[i];
+		bool empty = false;
+		for (struct slab* slab = c->slabs; slab && !empty; slab = slab->next) {
+			empty = slab->used == 0;
+		}
+		if (!empty) {
+			continue;
+		}
+
+		// drop the blocks of the empty slabs from the free list, then them
+		struct free_block** pb = &c->free;
+		while (*pb) {
+			struct slab* slab = _find_slab(c, *pb);
+			if (slab->used == 0) {
+				*pb = (*pb)->next;
+			} else {
+				pb = &(*pb)->next;
+			}
+		}
+		struct slab** ps = &c->slabs;
+		while (*ps) {
+			struct slab* slab = *ps;
+			if (slab->used == 0) {
+				*ps = slab->next;
+				size_t sz = SLAB_HEADER + c->block * slab->blocks;
+				sl->bytes -= sz;
+				reclaimed += sz;
+				--sl->empty;
+				free(slab);
+			} else {
+				ps = &slab->next;
+			}
+		}
+	}
+	return reclaimed;
+}
+
+size_t
+gtxt_slab_get_bytes(struct gtxt_slab* sl) {
+	return sl->bytes;
+}
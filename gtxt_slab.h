@@ -0,0 +1,39 @@
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifndef gametext_slab_h
+#define gametext_slab_h
+
+#include <stddef.h>
+
+// blocks in size classes a quarter of a power of two apart, carved from
+// slabs and recycled through a free list per class; sizes past the largest
+// class go to the heap
+
+struct gtxt_slab;
+
+struct gtxt_slab* gtxt_slab_create();
+void gtxt_slab_release(struct gtxt_slab*);
+
+// what sz is rounded up to, the bytes a block holds
+size_t gtxt_slab_block_size(size_t sz);
+
+void* gtxt_slab_alloc(struct gtxt_slab*, size_t sz);
+// sz as passed to gtxt_slab_alloc() or its block size
+void  gtxt_slab_free(struct gtxt_slab*, void* ptr, size_t sz);
+// what gtxt_slab_alloc() would add to the bytes, 0 if a free block is at hand
+size_t gtxt_slab_alloc_bytes(struct gtxt_slab*, size_t sz);
+
+// frees the slabs with no block in use, returns the bytes reclaimed; cheap
+// when there are none
+size_t gtxt_slab_trim(struct gtxt_slab*);
+// of slabs and heap blocks, used or not
+size_t gtxt_slab_get_bytes(struct gtxt_slab*);
+
+#endif // gametext_slab_h
+
+#ifdef __cplusplus
+}
+#endif
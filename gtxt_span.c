@@ -0,0 +1,137 @@
+#include "gtxt_span.h"
+
+#include <string.h>
+
+// a token byte is a kind and a run length of 1 to 64
+#define KIND_ZERO    0
+#define KIND_FULL    1
+// followed by the value
+#define KIND_REPEAT  2
+// followed by the values
+#define KIND_LITERAL 3
+
+#define MAX_RUN 64
+
+#define TOKEN(kind, len) (uint8_t)(((kind) << 6) | ((len) - 1))
+
+static inline int
+_run_len(const uint8_t* cov, int channels, size_t pos, size_t n) {
+	uint8_t v = cov[pos * channels];
+	int len = 1;
+	while (len < MAX_RUN && pos + len < n && cov[(pos + len) * channels] == v) {
+		++len;
+	}
+	return len;
+}
+
+// worth a token of its own rather than staying in a literal
+static inline bool
+_is_run(uint8_t v, int len) {
+	return (v == 0 || v == 255) ? len >= 2 : len >= 3;
+}
+
+static inline void
+_put(uint8_t* dst, size_t cap, size_t* sz, uint8_t v) {
+	if (*sz < cap) {
+		dst[*sz] = v;
+	}
+	++*sz;
+}
+
+size_t
+gtxt_span_encode(const uint8_t* cov, int w, int h, int channels, uint8_t* dst, size_t cap) {
+	if (!dst) {
+		cap = 0;
+	}
+
+	size_t n = (size_t)w * h;
+	size_t sz = 0;
+	for (int c = 0; c < channels; ++c) {
+		const uint8_t* plane = cov + c;
+		size_t pos = 0;
+		while (pos < n) {
+			uint8_t v = plane[pos * channels];
+			int len = _run_len(plane, channels, pos, n);
+			if (v == 0 || v == 255) {
+				_put(dst, cap, &sz, TOKEN(v == 0 ? KIND_ZERO : KIND_FULL, len));
+				pos += len;
+			} else if (len >= 3) {
+				_put(dst, cap, &sz, TOKEN(KIND_REPEAT, len));
+				_put(dst, cap, &sz, v);
+				pos += len;
+			} else {
+				// up to the next run
+				size_t end = pos + len;
+				while (end < n && end - pos < MAX_RUN) {
+					int next = _run_len(plane, channels, end, n);
+					if (_is_run(plane[end * channels], next)) {
+						break;
+					}
+					end += next;
+				}
+				if (end - pos > MAX_RUN) {
+					end = pos + MAX_RUN;
+				}
+				_put(dst, cap, &sz, TOKEN(KIND_LITERAL, (int)(end - pos)));
+				for (; pos < end; ++pos) {
+					_put(dst, cap, &sz, plane[pos * channels]);
+				}
+			}
+		}
+	}
+	return sz;
+}
+
+bool
+gtxt_span_decode(const uint8_t* src, size_t sz, int w, int h, int channels, uint8_t* dst) {
+	size_t n = (size_t)w * h;
+	const uint8_t* end = src + sz;
+	for (int c = 0; c < channels; ++c) {
+		uint8_t* plane = dst + c;
+		size_t pos = 0;
+		while (pos < n) {
+			if (src == end) {
+				return false;
+			}
+			int kind = *src >> 6;
+			size_t len = (size_t)(*src & (MAX_RUN - 1)) + 1;
+			++src;
+			if (pos + len > n) {
+				return false;
+			}
+
+			switch (kind)
+			{
+			case KIND_LITERAL:
+				if ((size_t)(end - src) < len) {
+					return false;
+				}
+				for (size_t i = 0; i < len; ++i) {
+					plane[(pos + i) * channels] = src[i];
+				}
+				src += len;
+				break;
+			default:
+			{
+				uint8_t v = kind == KIND_ZERO ? 0 : 255;
+				if (kind == KIND_REPEAT) {
+					if (src == end) {
+						return false;
+					}
+					v = *src++;
+				}
+				if (channels == 1) {
+					memset(plane + pos, v, len);
+				} else {
+					for (size_t i = 0; i < len; ++i) {
+						plane[(pos + i) * channels] = v;
+					}
+				}
+			}
+				break;
+			}
+			pos += len;
+		}
+	}
+	return src == end;
+}
@@ -0,0 +1,27 @@
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifndef gametext_span_h
+#define gametext_span_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 8-bit coverage as runs, each channel plane on its own so fill and edge
+// runs don't break each other up; empty and fully covered runs take a byte
+// per 64 pixels
+
+// of w * h pixels with channels interleaved, returns the bytes needed and
+// fills dst only if they fit in cap
+size_t gtxt_span_encode(const uint8_t* cov, int w, int h, int channels, uint8_t* dst, size_t cap);
+// back into interleaved coverage, false if src is not of w * h pixels
+bool   gtxt_span_decode(const uint8_t* src, size_t sz, int w, int h, int channels, uint8_t* dst);
+
+#endif // gametext_span_h
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,103 @@
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifndef gametext_thread_h
+#define gametext_thread_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#	include <windows.h>
+#else
+#	include <pthread.h>
+#	include <time.h>
+#endif
+
+#ifdef _MSC_VER
+#	define GTXT_THREAD_LOCAL __declspec(thread)
+#else
+#	define GTXT_THREAD_LOCAL __thread
+#endif
+
+#ifdef _WIN32
+
+typedef CRITICAL_SECTION gtxt_mutex;
+
+static inline void gtxt_mutex_init(gtxt_mutex* m)    { InitializeCriticalSection(m); }
+static inline void gtxt_mutex_release(gtxt_mutex* m) { DeleteCriticalSection(m); }
+static inline void gtxt_mutex_lock(gtxt_mutex* m)    { EnterCriticalSection(m); }
+static inline void gtxt_mutex_unlock(gtxt_mutex* m)  { LeaveCriticalSection(m); }
+
+typedef CONDITION_VARIABLE gtxt_cond;
+
+static inline void gtxt_cond_init(gtxt_cond* c)                 { InitializeConditionVariable(c); }
+static inline void gtxt_cond_release(gtxt_cond* c)              { (void)c; }
+static inline void gtxt_cond_wait(gtxt_cond* c, gtxt_mutex* m)  { SleepConditionVariableCS(c, m, INFINITE); }
+static inline void gtxt_cond_signal(gtxt_cond* c)               { WakeConditionVariable(c); }
+static inline void gtxt_cond_broadcast(gtxt_cond* c)            { WakeAllConditionVariable(c); }
+
+typedef HANDLE gtxt_thread;
+typedef LPTHREAD_START_ROUTINE gtxt_thread_func;
+
+#define GTXT_THREAD_FUNC(name, arg) DWORD WINAPI name(LPVOID arg)
+#define GTXT_THREAD_RETURN return 0
+
+static inline bool gtxt_thread_create(gtxt_thread* t, gtxt_thread_func func, void* arg) {
+	*t = CreateThread(NULL, 0, func, arg, 0, NULL);
+	return *t != NULL;
+}
+static inline void gtxt_thread_join(gtxt_thread t) { WaitForSingleObject(t, INFINITE); CloseHandle(t); }
+
+// monotonic
+static inline uint64_t gtxt_time_us() {
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (uint64_t)(now.QuadPart / freq.QuadPart * 1000000 + now.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart);
+}
+
+#else
+
+typedef pthread_mutex_t gtxt_mutex;
+
+static inline void gtxt_mutex_init(gtxt_mutex* m)    { pthread_mutex_init(m, NULL); }
+static inline void gtxt_mutex_release(gtxt_mutex* m) { pthread_mutex_destroy(m); }
+static inline void gtxt_mutex_lock(gtxt_mutex* m)    { pthread_mutex_lock(m); }
+static inline void gtxt_mutex_unlock(gtxt_mutex* m)  { pthread_mutex_unlock(m); }
+
+typedef pthread_cond_t gtxt_cond;
+
+static inline void gtxt_cond_init(gtxt_cond* c)                 { pthread_cond_init(c, NULL); }
+static inline void gtxt_cond_release(gtxt_cond* c)              { pthread_cond_destroy(c); }
+static inline void gtxt_cond_wait(gtxt_cond* c, gtxt_mutex* m)  { pthread_cond_wait(c, m); }
+static inline void gtxt_cond_signal(gtxt_cond* c)               { pthread_cond_signal(c); }
+static inline void gtxt_cond_broadcast(gtxt_cond* c)            { pthread_cond_broadcast(c); }
+
+typedef pthread_t gtxt_thread;
+typedef void* (*gtxt_thread_func)(void*);
+
+#define GTXT_THREAD_FUNC(name, arg) void* name(void* arg)
+#define GTXT_THREAD_RETURN return NULL
+
+static inline bool gtxt_thread_create(gtxt_thread* t, gtxt_thread_func func, void* arg) {
+	return pthread_create(t, NULL, func, arg) == 0;
+}
+static inline void gtxt_thread_join(gtxt_thread t) { pthread_join(t, NULL); }
+
+// monotonic
+static inline uint64_t gtxt_time_us() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+#endif // _WIN32
+
+#endif // gametext_thread_h
+
+#ifdef __cplusplus
+}
+#endif
\ No newline at end of file
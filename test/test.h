@@ -0,0 +1,25 @@
+#ifndef gametext_test_h
+#define gametext_test_h
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// not compiled out with NDEBUG as assert() is
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+		exit(1); \
+	} \
+} while (0)
+
+// reported as skipped by ctest
+#define TEST_SKIP 77
+
+// deterministic across platforms, unlike rand()
+static inline unsigned int
+test_rand(unsigned int* state) {
+	*state = *state * 1103515245u + 12345u;
+	return *state >> 8;
+}
+
+#endif // gametext_test_h
@@ -0,0 +1,117 @@
+#include "test.h"
+#include "gtxt_atlas.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define COUNT 400
+#define SIZE 128
+
+static bool
+_overlap(const struct gtxt_atlas_region* a, const struct gtxt_atlas_region* b) {
+	return a->page == b->page
+		&& a->x < b->x + b->w && b->x < a->x + a->w
+		&& a->y < b->y + b->h && b->y < a->y + a->h;
+}
+
+static void
+_fill(struct gtxt_atlas* a, const struct gtxt_atlas_region* r, uint8_t v) {
+	uint8_t buf[32 * 32];
+	memset(buf, v, (size_t)r->w * r->h);
+	gtxt_atlas_write(a, r, buf);
+}
+
+static void
+_check_fill(struct gtxt_atlas* a, const struct gtxt_atlas_region* r, uint8_t v) {
+	uint8_t buf[32 * 32];
+	CHECK(gtxt_atlas_read(a, r, buf));
+	for (int i = 0; i < r->w * r->h; ++i) {
+		CHECK(buf[i] == v);
+	}
+}
+
+// random alloc and free on one page, checking the live regions keep their
+// pixels and never overlap
+static void
+_churn() {
+	struct gtxt_atlas* a = gtxt_atlas_create(SIZE, SIZE, 1, 1);
+	CHECK(a);
+	static struct gtxt_atlas_region r[COUNT];
+	static bool live[COUNT];
+	unsigned int seed = 5;
+	int version = -1;
+	for (int step = 0; step < 100000; ++step) {
+		int i = (int)(test_rand(&seed) % COUNT);
+		if (live[i] && r[i].version == version) {
+			_check_fill(a, &r[i], (uint8_t)(i + 1));
+			gtxt_atlas_free(a, &r[i]);
+			live[i] = false;
+			continue;
+		}
+		int w = 1 + (int)(test_rand(&seed) % 20),
+			h = 1 + (int)(test_rand(&seed) % 20);
+		if (!gtxt_atlas_alloc(a, w, h, &r[i])) {
+			continue;
+		}
+		if (r[i].version != version) {
+			// the page was reset, by recycling or emptying
+			version = r[i].version;
+			memset(live, 0, sizeof(live));
+		}
+		for (int j = 0; j < COUNT; ++j) {
+			CHECK(!live[j] || !_overlap(&r[i], &r[j]));
+		}
+		_fill(a, &r[i], (uint8_t)(i + 1));
+		live[i] = true;
+	}
+
+	// emptied, the whole page is there again
+	for (int i = 0; i < COUNT; ++i) {
+		if (live[i] && r[i].version == version) {
+			gtxt_atlas_free(a, &r[i]);
+		}
+	}
+	struct gtxt_atlas_region full;
+	CHECK(gtxt_atlas_alloc(a, SIZE - 1, SIZE - 1, &full));
+	gtxt_atlas_release(a);
+}
+
+int
+main() {
+	_churn();
+
+	struct gtxt_atlas* a = gtxt_atlas_create(SIZE, SIZE, 1, 1);
+	CHECK(a);
+
+	// the last one freed lowers the skyline, its place is taken again
+	struct gtxt_atlas_region r0, r1, r2;
+	CHECK(gtxt_atlas_alloc(a, 10, 10, &r0));
+	CHECK(gtxt_atlas_alloc(a, 10, 10, &r1));
+	gtxt_atlas_free(a, &r1);
+	CHECK(gtxt_atlas_alloc(a, 10, 10, &r2));
+	CHECK(r2.x == r1.x && r2.y == r1.y && r2.version == r1.version);
+
+	// freed under others, a hole the next fits in, and blanked
+	struct gtxt_atlas_region r3, hole;
+	_fill(a, &r0, 9);
+	CHECK(gtxt_atlas_alloc(a, SIZE - 1, 20, &r3));
+	gtxt_atlas_free(a, &r0);
+	CHECK(gtxt_atlas_alloc(a, 6, 6, &hole));
+	CHECK(hole.x == r0.x && hole.y == r0.y && hole.version == r0.version);
+	_check_fill(a, &hole, 0);
+
+	// a pinned page isn't recycled when full
+	gtxt_atlas_pin(a, &r3, true);
+	struct gtxt_atlas_region big;
+	CHECK(!gtxt_atlas_alloc(a, SIZE - 1, SIZE - 1, &big));
+	CHECK(gtxt_atlas_is_valid(a, &r3));
+	gtxt_atlas_pin(a, &r3, false);
+	CHECK(gtxt_atlas_alloc(a, SIZE - 1, SIZE - 1, &big));
+	CHECK(!gtxt_atlas_is_valid(a, &r3));
+
+	// too large for a page
+	CHECK(!gtxt_atlas_alloc(a, SIZE, 1, &big));
+
+	gtxt_atlas_release(a);
+	return 0;
+}
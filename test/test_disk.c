@@ -0,0 +1,137 @@
+#include "test.h"
+#include "gtxt_disk.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define FILEPATH "test_disk.bin"
+#define FORMAT 7
+#define FLAGS 3
+#define COUNT 300
+
+struct head {
+	int key;
+	int font;
+};
+
+static bool
+_equal(const void* key, const void* record) {
+	return *(const int*)key == ((const struct head*)record)->key;
+}
+
+// a few keys to a hash, some records without data
+static uint64_t
+_hash(int key) {
+	return (uint64_t)(key % 97) * 0x9E3779B97F4A7C15ULL;
+}
+
+static size_t
+_data_size(int key) {
+	return (size_t)(key % 5) * 13;
+}
+
+static void
+_write_raw(const char* filepath, const void* buf, size_t sz) {
+	FILE* fp = fopen(filepath, "wb");
+	CHECK(fp);
+	CHECK(fwrite(buf, 1, sz, fp) == sz);
+	fclose(fp);
+}
+
+int
+main() {
+	uint64_t checksums[2] = { 11, 22 };
+
+	struct gtxt_disk_writer* w = gtxt_disk_writer_create(FORMAT, FLAGS, checksums, 2);
+	CHECK(w);
+	uint8_t data[64];
+	for (int i = 0; i < COUNT; ++i) {
+		struct head h = { i, i % 2 };
+		memset(data, i & 0xff, sizeof(data));
+		CHECK(gtxt_disk_writer_add(w, _hash(i), h.font, &h, sizeof(h), data, _data_size(i)));
+	}
+	CHECK(gtxt_disk_writer_save(w, FILEPATH));
+	gtxt_disk_writer_release(w);
+
+	struct gtxt_disk* d = gtxt_disk_open(FILEPATH, FORMAT, checksums, 2);
+	CHECK(d);
+	CHECK(gtxt_disk_get_flags(d) == FLAGS);
+	CHECK(gtxt_disk_count(d) == COUNT);
+	for (int i = 0; i < COUNT; ++i) {
+		size_t sz = 0;
+		const uint8_t* rec = (const uint8_t*)gtxt_disk_query(d, _hash(i), &i, _equal, &sz);
+		CHECK(rec && ((uintptr_t)rec % 16) == 0);
+		CHECK(sz == sizeof(struct head) + _data_size(i));
+		for (size_t j = sizeof(struct head); j < sz; ++j) {
+			CHECK(rec[j] == (i & 0xff));
+		}
+	}
+	int missing = COUNT;
+	CHECK(!gtxt_disk_query(d, _hash(missing), &missing, _equal, NULL));
+	// sorted by hash
+	uint64_t prev = 0;
+	for (int i = 0; i < COUNT; ++i) {
+		uint64_t hash;
+		CHECK(gtxt_disk_get(d, i, &hash, NULL));
+		CHECK(hash >= prev);
+		prev = hash;
+	}
+	CHECK(!gtxt_disk_get(d, COUNT, NULL, NULL));
+	gtxt_disk_close(d);
+
+	// the second font changed, its records are gone
+	uint64_t changed[2] = { 11, 23 };
+	d = gtxt_disk_open(FILEPATH, FORMAT, changed, 2);
+	CHECK(d);
+	for (int i = 0; i < COUNT; ++i) {
+		CHECK((gtxt_disk_query(d, _hash(i), &i, _equal, NULL) != NULL) == (i % 2 == 0));
+	}
+	gtxt_disk_close(d);
+
+	// fewer fonts now
+	d = gtxt_disk_open(FILEPATH, FORMAT, checksums, 1);
+	CHECK(d);
+	int odd = 1;
+	CHECK(!gtxt_disk_query(d, _hash(odd), &odd, _equal, NULL));
+	gtxt_disk_close(d);
+
+	// another format
+	CHECK(!gtxt_disk_open(FILEPATH, FORMAT + 1, checksums, 2));
+
+	// replaced while mapped
+	d = gtxt_disk_open(FILEPATH, FORMAT, checksums, 2);
+	CHECK(d);
+	w = gtxt_disk_writer_create(FORMAT, FLAGS + 1, checksums, 2);
+	CHECK(w);
+#ifdef _WIN32
+	gtxt_disk_close(d);
+	d = NULL;
+#endif
+	CHECK(gtxt_disk_writer_save(w, FILEPATH));
+	gtxt_disk_writer_release(w);
+	if (d) {
+		CHECK(gtxt_disk_count(d) == COUNT);
+		gtxt_disk_close(d);
+	}
+	d = gtxt_disk_open(FILEPATH, FORMAT, checksums, 2);
+	CHECK(d);
+	CHECK(gtxt_disk_get_flags(d) == FLAGS + 1 && gtxt_disk_count(d) == 0);
+	gtxt_disk_close(d);
+
+	// truncated and bogus files
+	CHECK(!gtxt_disk_open("test_disk_none.bin", FORMAT, checksums, 2));
+	_write_raw(FILEPATH, "GTXD", 4);
+	CHECK(!gtxt_disk_open(FILEPATH, FORMAT, checksums, 2));
+	uint32_t bogus[8] = { 0 };
+	memcpy(bogus, "GTXD", 4);
+	bogus[1] = 1;
+	bogus[2] = 0x01020304;
+	bogus[3] = FORMAT;
+	bogus[5] = 2;
+	bogus[6] = 0xffffffffu;
+	_write_raw(FILEPATH, bogus, sizeof(bogus));
+	CHECK(!gtxt_disk_open(FILEPATH, FORMAT, checksums, 2));
+
+	remove(FILEPATH);
+	return 0;
+}
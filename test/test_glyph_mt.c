@@ -0,0 +1,154 @@
+#include "test.h"
+#include "gtxt_glyph.h"
+#include "gtxt_freetype.h"
+#include "gtxt_thread.h"
+
+#include <string.h>
+
+// user font glyphs only, so no font file is needed; char_gen isn't told the
+// unicode, so the bitmaps' size and pixels come from the font size
+
+#define THREAD_COUNT 4
+#define STEPS 20000
+#define UNICODES 600
+
+static uint32_t PIXELS[32 * 32];
+
+static void
+_get_uf_layout(int unicode, int font, struct gtxt_glyph_layout* layout) {
+	(void)font;
+	memset(layout, 0, sizeof(*layout));
+	layout->sizer.width = (float)(1 + unicode % 13);
+	layout->sizer.height = (float)(1 + unicode % 7);
+	layout->advance = layout->sizer.width + 1;
+	layout->metrics_height = layout->sizer.height;
+}
+
+static uint32_t
+_pixel(int w, int h, int font_size) {
+	return 0xff000000u | (uint32_t)font_size << 16 | (uint32_t)w << 8 | (uint32_t)h;
+}
+
+static void
+_size(int font_size, int* w, int* h) {
+	*w = font_size - 7;
+	*h = font_size % 5 + 2;
+}
+
+// called under the cache's raster lock
+static uint32_t*
+_char_gen(const char* str, const struct gtxt_glyph_style* style, struct gtxt_glyph_layout* layout) {
+	(void)str;
+	int w, h;
+	_size(style->font_size, &w, &h);
+	memset(layout, 0, sizeof(*layout));
+	layout->sizer.width = (float)w;
+	layout->sizer.height = (float)h;
+	layout->advance = (float)w + 1;
+	layout->metrics_height = (float)h;
+	for (int i = 0; i < w * h; ++i) {
+		PIXELS[i] = _pixel(w, h, style->font_size);
+	}
+	return PIXELS;
+}
+
+struct worker {
+	unsigned int seed;
+	int drawn;
+};
+
+static void
+_style(struct gtxt_glyph_style* style, int font_size) {
+	memset(style, 0, sizeof(*style));
+	style->font = 0;
+	style->font_size = font_size;
+	style->font_color.mode.ONE.color.integer = 0xffffffff;
+}
+
+static GTXT_THREAD_FUNC(_worker_func, ud) {
+	struct worker* wk = (struct worker*)ud;
+	uint32_t dst[32 * 32];
+	for (int i = 0; i < STEPS; ++i) {
+		int unicode = 32 + (int)(test_rand(&wk->seed) % UNICODES);
+		struct gtxt_glyph_style style;
+		_style(&style, 10 + (int)(test_rand(&wk->seed) % 3));
+		int w, h;
+		_size(style.font_size, &w, &h);
+
+		// of get_uf_layout, or of char_gen once drawn
+		struct gtxt_glyph_layout layout;
+		if (test_rand(&wk->seed) % 4 == 0) {
+			if (gtxt_glyph_query_layout(unicode, 0, &style, &layout)) {
+				CHECK(((int)layout.sizer.width == 1 + unicode % 13 && (int)layout.sizer.height == 1 + unicode % 7)
+				   || ((int)layout.sizer.width == w && (int)layout.sizer.height == h));
+			}
+			continue;
+		}
+
+		// 0 when out of room, such as atlas pages all held
+		int n = gtxt_glyph_copy_bitmap(unicode, 0, &style, &layout, dst, 32 * 32);
+		if (n == 0) {
+			continue;
+		}
+		CHECK(n == w * h);
+		for (int j = 0; j < n; ++j) {
+			CHECK(dst[j] == _pixel(w, h, style.font_size));
+		}
+		++wk->drawn;
+	}
+	gtxt_glyph_thread_release();
+	GTXT_THREAD_RETURN;
+}
+
+static void
+_run() {
+	struct worker workers[THREAD_COUNT];
+	gtxt_thread threads[THREAD_COUNT];
+	for (int i = 0; i < THREAD_COUNT; ++i) {
+		workers[i].seed = (unsigned int)i + 1;
+		workers[i].drawn = 0;
+		CHECK(gtxt_thread_create(&threads[i], _worker_func, &workers[i]));
+	}
+
+	// the main thread changes what the workers see meanwhile
+	unsigned int seed = 99;
+	for (int i = 0; i < 200; ++i) {
+		gtxt_glyph_frame_begin();
+		struct gtxt_glyph_stats st;
+		gtxt_glyph_get_stats(&st);
+		CHECK(st.bitmap.hits + st.bitmap.misses >= st.bitmap.evictions);
+		gtxt_glyph_frame_end();
+		if (i % 50 == 25) {
+			CHECK(gtxt_glyph_resize(32 + (int)(test_rand(&seed) % 200), 64 + (int)(test_rand(&seed) % 400)));
+		}
+	}
+
+	int drawn = 0;
+	for (int i = 0; i < THREAD_COUNT; ++i) {
+		gtxt_thread_join(threads[i]);
+		drawn += workers[i].drawn;
+	}
+	CHECK(drawn > 0);
+}
+
+int
+main() {
+	gtxt_ft_create();
+
+	// small caps, so glyphs are evicted all along
+	gtxt_glyph_create_concurrent(64, 128, 4, _char_gen, _get_uf_layout);
+	_run();
+
+	// a slab or a few per shard
+	gtxt_glyph_set_bitmap_budget(4 * 64 * 1024);
+	_run();
+
+	// pages recycled under the frame scope
+	gtxt_glyph_set_bitmap_budget(0);
+	gtxt_glyph_enable_atlas(64, 64, 2);
+	_run();
+
+	gtxt_glyph_release();
+	gtxt_ft_release();
+	return 0;
+}
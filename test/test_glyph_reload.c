@@ -0,0 +1,88 @@
+#include "test.h"
+#include "gtxt_glyph.h"
+#include "gtxt_freetype.h"
+
+#include <string.h>
+
+// glyphs of a font reloaded from another file mustn't be saved, neither the
+// drawn ones nor the ones carried over from the loaded cache file
+
+#define FILEPATH "test_glyph_reload.bin"
+
+static const char* FONT_OLD;
+static const char* FONT_NEW;
+
+static void
+_open(const char* font) {
+	gtxt_ft_create();
+	CHECK(gtxt_ft_add_font("test", font) == 0);
+	gtxt_glyph_create(64, 64, NULL, NULL);
+}
+
+static void
+_close() {
+	gtxt_glyph_release();
+	gtxt_ft_release();
+}
+
+static uint64_t
+_disk_loads() {
+	struct gtxt_glyph_stats st;
+	gtxt_glyph_get_stats(&st);
+	return st.disk_loads;
+}
+
+// the disk loads it took
+static uint64_t
+_draw(int unicode) {
+	struct gtxt_glyph_style style;
+	memset(&style, 0, sizeof(style));
+	style.font = 0;
+	style.font_size = 24;
+	style.font_color.mode.ONE.color.integer = 0xffffffff;
+
+	uint64_t loads = _disk_loads();
+	struct gtxt_glyph_layout layout;
+	static uint32_t dst[128 * 128];
+	CHECK(gtxt_glyph_copy_bitmap(unicode, 0, &style, &layout, dst, 128 * 128) > 0);
+	return _disk_loads() - loads;
+}
+
+int
+main(int argc, char* argv[]) {
+	FONT_OLD = argc > 2 ? argv[1] : getenv("GTXT_TEST_FONT");
+	FONT_NEW = argc > 2 ? argv[2] : getenv("GTXT_TEST_FONT2");
+	if (!FONT_OLD || !FONT_NEW || !*FONT_OLD || !*FONT_NEW) {
+		fprintf(stderr, "no fonts given, skipped\n");
+		return TEST_SKIP;
+	}
+	remove(FILEPATH);
+
+	// 'A' and 'C' of the old font saved
+	_open(FONT_OLD);
+	CHECK(_draw('A') == 0);
+	CHECK(_draw('C') == 0);
+	CHECK(gtxt_glyph_save_cache(FILEPATH));
+	_close();
+
+	// 'A' loaded and 'C' left on disk, then 'B' drawn from the new font
+	_open(FONT_OLD);
+	CHECK(gtxt_glyph_load_cache(FILEPATH));
+	CHECK(_draw('A') == 1);
+	CHECK(gtxt_ft_reload_font(0, FONT_NEW));
+	gtxt_glyph_invalidate_font(0);
+	CHECK(_draw('B') == 0);
+	CHECK(gtxt_glyph_save_cache(FILEPATH));
+	_close();
+
+	// only the new font's glyphs come back
+	_open(FONT_NEW);
+	CHECK(gtxt_glyph_load_cache(FILEPATH));
+	CHECK(_draw('B') == 1);
+	CHECK(_draw('A') == 0);
+	CHECK(_draw('C') == 0);
+	_close();
+
+	remove(FILEPATH);
+	return 0;
+}
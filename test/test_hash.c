@@ -0,0 +1,106 @@
+#include "test.h"
+#include "gtxt_hash.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#define COUNT 5000
+
+struct item {
+	int key;
+	bool in;
+};
+
+static bool
+_equal(const void* key, const void* val) {
+	return *(const int*)key == ((const struct item*)val)->key;
+}
+
+// four keys to each hash, left to equal() to tell apart
+static uint64_t
+_hash(int key) {
+	return gtxt_hash_finish(gtxt_hash_mix(0, (uint64_t)(key % (COUNT / 4))));
+}
+
+static void
+_check_all(struct gtxt_hash* h, struct item* items) {
+	int size = 0;
+	for (int i = 0; i < COUNT; ++i) {
+		struct item* it = (struct item*)gtxt_hash_query(h, _hash(i), &i, _equal);
+		CHECK(it == (items[i].in ? &items[i] : NULL));
+		size += items[i].in;
+	}
+	CHECK(gtxt_hash_size(h) == size);
+}
+
+int
+main() {
+	struct item items[COUNT];
+	for (int i = 0; i < COUNT; ++i) {
+		items[i].key = i;
+		items[i].in = false;
+	}
+
+	// grows from the smallest table through inserts
+	struct gtxt_hash* h = gtxt_hash_create(1);
+	CHECK(h);
+	for (int i = 0; i < COUNT; ++i) {
+		CHECK(gtxt_hash_insert(h, _hash(i), &items[i]));
+		items[i].in = true;
+	}
+	_check_all(h, items);
+
+	for (int i = 0; i < COUNT; i += 2) {
+		CHECK(gtxt_hash_remove(h, _hash(i), &items[i]));
+		items[i].in = false;
+	}
+	CHECK(!gtxt_hash_remove(h, _hash(0), &items[0]));
+	_check_all(h, items);
+
+	// incremental rehash, with lookups, inserts and removes while both
+	// tables are live
+	gtxt_hash_reserve(h, COUNT * 4);
+	CHECK(!gtxt_hash_move(h, 0));
+	unsigned int seed = 1;
+	int steps = 0;
+	while (!gtxt_hash_move(h, 1)) {
+		int i = (int)(test_rand(&seed) % COUNT);
+		if (items[i].in) {
+			CHECK(gtxt_hash_query(h, _hash(i), &i, _equal) == &items[i]);
+			CHECK(gtxt_hash_remove(h, _hash(i), &items[i]));
+			items[i].in = false;
+		} else {
+			CHECK(!gtxt_hash_query(h, _hash(i), &i, _equal));
+			CHECK(gtxt_hash_insert(h, _hash(i), &items[i]));
+			items[i].in = true;
+		}
+		++steps;
+	}
+	CHECK(steps > 0);
+	_check_all(h, items);
+
+	// shrinking to the size, then a second move started over an unfinished one
+	gtxt_hash_reserve(h, 0);
+	gtxt_hash_query(h, _hash(1), &(int){ 1 }, _equal);
+	gtxt_hash_reserve(h, COUNT * 8);
+	_check_all(h, items);
+	while (!gtxt_hash_move(h, 4)) {
+	}
+	_check_all(h, items);
+
+	gtxt_hash_clear(h);
+	for (int i = 0; i < COUNT; ++i) {
+		items[i].in = false;
+	}
+	_check_all(h, items);
+
+	struct gtxt_hash_stats st;
+	gtxt_hash_get_stats(h, &st);
+	CHECK(st.lookups > 0 && st.probes >= st.lookups && st.max_probe >= 1);
+	gtxt_hash_reset_stats(h);
+	gtxt_hash_get_stats(h, &st);
+	CHECK(st.lookups == 0);
+
+	gtxt_hash_release(h);
+	return 0;
+}
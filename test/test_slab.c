@@ -0,0 +1,73 @@
+#include "test.h"
+#include "gtxt_slab.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define COUNT 4000
+
+int
+main() {
+	struct gtxt_slab* sl = gtxt_slab_create();
+	CHECK(sl);
+
+	static void* ptrs[COUNT];
+	static size_t sizes[COUNT];
+	unsigned int seed = 3;
+
+	// a fresh class needs a slab, the next block comes from it
+	CHECK(gtxt_slab_alloc_bytes(sl, 10) > 0);
+	void* p = gtxt_slab_alloc(sl, 10);
+	CHECK(p);
+	CHECK(gtxt_slab_alloc_bytes(sl, 10) == 0);
+	CHECK(gtxt_slab_block_size(10) >= 10);
+	gtxt_slab_free(sl, p, 10);
+
+	// small and heap sized blocks, each filled with its index
+	for (int i = 0; i < COUNT; ++i) {
+		sizes[i] = 1 + test_rand(&seed) % (i % 10 == 0 ? 100000 : 2000);
+		size_t before = gtxt_slab_get_bytes(sl);
+		size_t expect = gtxt_slab_alloc_bytes(sl, sizes[i]);
+		ptrs[i] = gtxt_slab_alloc(sl, sizes[i]);
+		CHECK(ptrs[i]);
+		CHECK(gtxt_slab_get_bytes(sl) == before + expect);
+		CHECK(gtxt_slab_block_size(sizes[i]) >= sizes[i]);
+		memset(ptrs[i], i & 0xff, sizes[i]);
+	}
+
+	// half freed, by size or by block size, and taken again
+	for (int i = 0; i < COUNT; i += 2) {
+		gtxt_slab_free(sl, ptrs[i], i % 4 == 0 ? sizes[i] : gtxt_slab_block_size(sizes[i]));
+		ptrs[i] = NULL;
+	}
+	for (int i = 1; i < COUNT; i += 2) {
+		const uint8_t* b = (const uint8_t*)ptrs[i];
+		for (size_t j = 0; j < sizes[i]; ++j) {
+			CHECK(b[j] == (i & 0xff));
+		}
+	}
+	size_t before = gtxt_slab_get_bytes(sl);
+	gtxt_slab_trim(sl);
+	CHECK(gtxt_slab_get_bytes(sl) <= before);
+	for (int i = 0; i < COUNT; i += 2) {
+		ptrs[i] = gtxt_slab_alloc(sl, sizes[i]);
+		CHECK(ptrs[i]);
+		memset(ptrs[i], 0xee, sizes[i]);
+	}
+	for (int i = 1; i < COUNT; i += 2) {
+		const uint8_t* b = (const uint8_t*)ptrs[i];
+		CHECK(b[0] == (i & 0xff) && b[sizes[i] - 1] == (i & 0xff));
+	}
+
+	// everything back, trim leaves nothing
+	for (int i = 0; i < COUNT; ++i) {
+		gtxt_slab_free(sl, ptrs[i], sizes[i]);
+	}
+	before = gtxt_slab_get_bytes(sl);
+	CHECK(gtxt_slab_trim(sl) == before);
+	CHECK(gtxt_slab_get_bytes(sl) == 0);
+	CHECK(gtxt_slab_trim(sl) == 0);
+
+	gtxt_slab_release(sl);
+	return 0;
+}
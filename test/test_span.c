@@ -0,0 +1,85 @@
+#include "test.h"
+#include "gtxt_span.h"
+
+#include <stdint.h>
+#include <string.h>
+
+// sparse shapes with ramps at the edges, as glyph coverage has
+static void
+_fill(uint8_t* cov, int w, int h, int channels, unsigned int* seed) {
+	for (int i = 0; i < w * h; ++i) {
+		int x = i % w, y = i / w;
+		for (int c = 0; c < channels; ++c) {
+			uint8_t v;
+			unsigned int r = test_rand(seed) % 16;
+			if (x < w / 4 || y < h / 4 || r == 0) {
+				v = 0;
+			} else if (r < 12) {
+				v = 255;
+			} else {
+				v = (uint8_t)test_rand(seed);
+			}
+			cov[i * channels + c] = c == 0 ? v : (uint8_t)(255 - v);
+		}
+	}
+}
+
+static void
+_round_trip(const uint8_t* cov, int w, int h, int channels) {
+	size_t raw = (size_t)w * h * channels;
+	size_t sz = gtxt_span_encode(cov, w, h, channels, NULL, 0);
+	uint8_t* enc = (uint8_t*)malloc(sz + 1);
+	// room for the wider size below
+	uint8_t* dec = (uint8_t*)malloc((size_t)(w + 1) * h * channels + 1);
+	CHECK(enc && dec);
+
+	// too small, nothing written
+	if (sz > 0) {
+		enc[0] = 0xcd;
+		CHECK(gtxt_span_encode(cov, w, h, channels, enc, sz - 1) == sz);
+	}
+	CHECK(gtxt_span_encode(cov, w, h, channels, enc, sz) == sz);
+
+	memset(dec, 0xcd, raw + 1);
+	CHECK(gtxt_span_decode(enc, sz, w, h, channels, dec));
+	CHECK(memcmp(dec, cov, raw) == 0);
+	CHECK(dec[raw] == 0xcd);
+
+	// cut short, or of another size
+	if (sz > 0) {
+		CHECK(!gtxt_span_decode(enc, sz - 1, w, h, channels, dec));
+		CHECK(!gtxt_span_decode(enc, sz, w + 1, h, channels, dec));
+	}
+
+	free(enc);
+	free(dec);
+}
+
+int
+main() {
+	unsigned int seed = 7;
+	uint8_t* cov = (uint8_t*)malloc(256 * 256 * 2);
+	CHECK(cov);
+
+	static const int SIZES[][2] = { { 1, 1 }, { 3, 5 }, { 63, 2 }, { 64, 64 }, { 65, 17 }, { 256, 256 } };
+	for (size_t i = 0; i < sizeof(SIZES) / sizeof(SIZES[0]); ++i) {
+		int w = SIZES[i][0], h = SIZES[i][1];
+		for (int channels = 1; channels <= 2; ++channels) {
+			_fill(cov, w, h, channels, &seed);
+			_round_trip(cov, w, h, channels);
+
+			memset(cov, 0, (size_t)w * h * channels);
+			_round_trip(cov, w, h, channels);
+
+			memset(cov, 255, (size_t)w * h * channels);
+			_round_trip(cov, w, h, channels);
+		}
+	}
+
+	// long empty and full runs shrink to a byte per 64 pixels
+	memset(cov, 0, 256 * 256);
+	CHECK(gtxt_span_encode(cov, 256, 256, 1, NULL, 0) <= 256 * 256 / 64 + 16);
+
+	free(cov);
+	return 0;
+}